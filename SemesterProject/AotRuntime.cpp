@@ -0,0 +1,91 @@
+#include "AotRuntime.h"
+#include "HostServices.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+static long cyclesOf(const CPU& cpu, const long* words, long count) {
+    long cycles = 0;
+    for (long i = 0; i < count; i++) cycles += cpu.getCycleCost(decodeInstruction(words[i]).opcode);
+    return cycles;
+}
+
+// A block is only entered if memory still holds the words it was
+// translated from
+static bool blockMatches(const AotBlock& block, const long* memory) {
+    return std::equal(block.words, block.words + block.length, memory + block.start);
+}
+
+long runAot(CPU& cpu, const AotBlock* blocks, size_t count, long maxSteps) {
+    long* memory = cpu.nativeMemory();
+    long size = (long)cpu.getMemorySize();
+    std::vector<const AotBlock*> blockAt(size, nullptr);
+    std::vector<long> blockCycles(count);
+    for (size_t i = 0; i < count; i++) {
+        if (blocks[i].start >= 0 && blocks[i].start + blocks[i].length <= size) {
+            blockAt[blocks[i].start] = &blocks[i];
+            blockCycles[i] = cyclesOf(cpu, blocks[i].words, blocks[i].length);
+        }
+    }
+
+    long steps = 0;
+    AotState state = {memory, size, false, 0};
+    while (!cpu.isHalted() && (maxSteps < 0 || steps < maxSteps)) {
+        long pc = memory[PC];
+        const AotBlock* block = (pc >= 0 && pc < size) ? blockAt[pc] : nullptr;
+        if (block && (maxSteps < 0 || steps + block->length <= maxSteps) &&
+            cpu.canRunNative() && blockMatches(*block, memory)) {
+            state.kernelMode = cpu.isInKernelMode();
+            state.executed = 0;
+            long next = block->run(state);
+            if (state.executed > 0) {
+                memory[PC] = next;
+                long cycles = state.executed == block->length ? blockCycles[block - blocks]
+                                                              : cyclesOf(cpu, block->words, state.executed);
+                cpu.retireNative(pc, state.executed, cycles);
+                steps += state.executed;
+                continue;
+            }
+        }
+        // Not compiled, changed, or the first instruction needs the interpreter
+        cpu.step();
+        steps++;
+    }
+    return steps;
+}
+
+int aotMain(int argc, char* argv[], const char* defaultProgram, const AotBlock* blocks, size_t count) {
+    std::string filename = defaultProgram;
+    size_t memorySize = CPU::DEFAULT_MEMORY_SIZE;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--memory" && i + 1 < argc) {
+            memorySize = std::stoul(argv[i + 1]);
+            i++;
+        } else if (!arg.empty() && arg[0] != '-') {
+            filename = arg;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [program] [--memory <words>]" << std::endl;
+            return 1;
+        }
+    }
+    if (memorySize < 1000) {
+        std::cerr << "Error: Memory must hold at least the OS region (1000 words)" << std::endl;
+        return 1;
+    }
+    // Every region needs its own thread table entry
+    if (memorySize % 1000 != 0) {
+        std::cerr << "Error: Memory size must be a multiple of the 1000-word thread region" << std::endl;
+        return 1;
+    }
+
+    CPU cpu(memorySize);
+    registerHostServices(cpu);
+    if (!cpu.loadProgram(filename)) {
+        return 1;
+    }
+    runAot(cpu, blocks, count);
+    cpu.flushOutput();
+    cpu.printMemoryState();
+    return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef AOT_RUNTIME_H
+#define AOT_RUNTIME_H
+
+#include "CPU.h"
+
+// Runtime for C++ translations written by gtuc312-aot. Every basic block of
+// straight-line data instructions (SET, CPY, CPYI, ADD, ADDI, SUBI, ending
+// at a JIF) becomes a function over the CPU's memory. Everything else
+// (stack, CALL/RET, SYSCALL, USER, HLT, block instructions, faults) stays
+// with the interpreter, one CPU::step at a time.
+
+// What a block sees while it runs
+struct AotState {
+    long* memory;
+    long size;
+    bool kernelMode;
+    long executed;  // Set by the block: instructions it retired
+};
+
+// Returns the PC to continue at
+using AotBlockFunction = long (*)(AotState& state);
+
+struct AotBlock {
+    long start;         // Address of the first instruction
+    long length;        // Instructions in the block
+    const long* words;  // Instruction words the block was translated from
+    AotBlockFunction run;
+};
+
+// Checks made before each instruction. Whatever they reject is handed to
+// the interpreter, which raises the fault or reads/writes the PC itself.
+inline bool aotValid(const AotState& s, long address) {
+    return address > PC && address < s.size && (s.kernelMode || address >= 1000);
+}
+// Same target rules as JIF in the interpreter
+inline bool aotJumpTarget(const AotState& s, long target) {
+    return target >= THREAD_CODE_OFFSET && target < s.size && decodeInstruction(s.memory[target]).opcode != 0;
+}
+inline long aotExit(AotState& s, long executed, long pc) {
+    s.executed = executed;
+    return pc;
+}
+
+// Runs cpu like CPU::run, entering a block whenever the PC is at its start
+// and its words are unchanged in memory (self-modified code is interpreted)
+long runAot(CPU& cpu, const AotBlock* blocks, size_t count, long maxSteps = -1);
+
+// main() of a translated program: loads the program (argv[1] if given,
+// else defaultProgram) and runs it like simulate with debug mode 0
+int aotMain(int argc, char* argv[], const char* defaultProgram, const AotBlock* blocks, size_t count);
+
+#endif // AOT_RUNTIME_H
@@ -0,0 +1,308 @@
+#include "Assembler.h"
+#include <charconv>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+using Tokens = std::vector<std::string_view>;
+
+static const int MAX_MACRO_DEPTH = 16;
+
+static bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Splits a line on blanks, up to a # comment
+static void tokenize(std::string_view line, Tokens& tokens) {
+    tokens.clear();
+    size_t i = 0;
+    while (i < line.size()) {
+        while (i < line.size() && isBlank(line[i])) i++;
+        if (i == line.size() || line[i] == '#') break;
+        size_t start = i;
+        while (i < line.size() && !isBlank(line[i]) && line[i] != '#') i++;
+        tokens.push_back(line.substr(start, i - start));
+    }
+}
+
+static bool parseInteger(std::string_view text, long& value) {
+    const char* first = text.data();
+    const char* last = text.data() + text.size();
+    if (first < last && *first == '+') first++;
+    std::from_chars_result result = std::from_chars(first, last, value);
+    return result.ec == std::errc() && result.ptr == last && first < last;
+}
+
+static bool isSectionLine(const Tokens& tokens, const char* begin, const char* kind) {
+    return tokens.size() >= 3 && tokens[0] == begin && tokens[1] == kind && tokens[2] == "Section";
+}
+
+bool needsAssembly(std::string_view source) {
+    size_t pos = 0;
+    while (pos < source.size()) {
+        size_t eol = source.find('\n', pos);
+        if (eol == std::string_view::npos) eol = source.size();
+        std::string_view line = source.substr(pos, eol - pos);
+        pos = eol + 1;
+        size_t comment = line.find('#');
+        if (comment != std::string_view::npos) line = line.substr(0, comment);
+        if (line.find(':') != std::string_view::npos) return true;
+        size_t first = 0;
+        while (first < line.size() && isBlank(line[first])) first++;
+        std::string_view rest = line.substr(first);
+        if (rest.rfind(".const", 0) == 0 || rest.rfind(".macro", 0) == 0) return true;
+    }
+    return false;
+}
+
+class Assembler {
+public:
+    explicit Assembler(long labelBase) : labelBase(labelBase), nextNumber(0) {}
+
+    bool firstPass(std::string_view source);
+    bool secondPass(std::string& output);
+
+private:
+    struct Symbol {
+        std::string_view expression;  // Unresolved definition
+        long value;
+        int state;                    // 0 unresolved, 1 resolving, 2 resolved
+        size_t line;
+    };
+
+    struct Macro {
+        Tokens params;
+        std::vector<Tokens> body;
+    };
+
+    struct PendingInstruction {
+        long number;
+        Tokens tokens;  // Mnemonic and operands
+        size_t line;
+    };
+
+    struct PendingData {
+        std::string_view address;
+        std::string_view value;
+        size_t line;
+    };
+
+    long labelBase;
+    long nextNumber;
+    std::unordered_map<std::string_view, Symbol> symbols;
+    std::unordered_map<std::string_view, Macro> macros;
+    std::vector<PendingInstruction> instructions;
+    std::vector<PendingData> data;
+    std::vector<std::string_view> pendingLabels;  // Bound to the next instruction
+
+    bool define(std::string_view name, std::string_view expression, long value, int state, size_t line);
+    bool place(long number, const Tokens& tokens, size_t line, int depth);
+    bool resolve(std::string_view text, long& value, int depth = 0);
+};
+
+bool Assembler::define(std::string_view name, std::string_view expression, long value, int state, size_t line) {
+    if (name.empty()) {
+        std::cerr << "Error: line " << line << ": empty symbol name" << std::endl;
+        return false;
+    }
+    auto inserted = symbols.emplace(name, Symbol{expression, value, state, line});
+    if (!inserted.second) {
+        std::cerr << "Error: line " << line << ": symbol " << name << " already defined on line "
+                  << inserted.first->second.line << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Places an instruction or expands a macro invocation at number
+bool Assembler::place(long number, const Tokens& tokens, size_t line, int depth) {
+    auto macro = macros.find(tokens[0]);
+    if (macro == macros.end()) {
+        for (std::string_view label : pendingLabels) {
+            if (!define(label, {}, labelBase + number, 2, line)) return false;
+        }
+        pendingLabels.clear();
+        instructions.push_back({number, tokens, line});
+        nextNumber = number + 1;
+        return true;
+    }
+    if (depth >= MAX_MACRO_DEPTH) {
+        std::cerr << "Error: line " << line << ": macros nested too deeply in " << tokens[0] << std::endl;
+        return false;
+    }
+    const Macro& m = macro->second;
+    if (tokens.size() - 1 != m.params.size()) {
+        std::cerr << "Error: line " << line << ": macro " << tokens[0] << " takes " << m.params.size()
+                  << " arguments" << std::endl;
+        return false;
+    }
+    Tokens expanded;
+    for (size_t i = 0; i < m.body.size(); i++) {
+        expanded = m.body[i];
+        for (auto& token : expanded) {
+            for (size_t p = 0; p < m.params.size(); p++) {
+                if (token == m.params[p]) token = tokens[p + 1];
+            }
+        }
+        if (!place(i == 0 ? number : nextNumber, expanded, line, depth + 1)) return false;
+    }
+    return true;
+}
+
+bool Assembler::firstPass(std::string_view source) {
+    bool inData = false, inInstructions = false;
+    Macro* defining = nullptr;
+    Tokens tokens;
+    size_t lineNumber = 0;
+    size_t pos = 0;
+    while (pos < source.size()) {
+        size_t eol = source.find('\n', pos);
+        if (eol == std::string_view::npos) eol = source.size();
+        std::string_view line = source.substr(pos, eol - pos);
+        pos = eol + 1;
+        lineNumber++;
+        tokenize(line, tokens);
+        if (tokens.empty()) continue;
+
+        if (defining) {
+            if (tokens[0] == ".endm") defining = nullptr;
+            else defining->body.push_back(tokens);
+            continue;
+        }
+        if (tokens[0] == ".const") {
+            if (tokens.size() != 3) {
+                std::cerr << "Error: line " << lineNumber << ": expected .const NAME value" << std::endl;
+                return false;
+            }
+            if (!define(tokens[1], tokens[2], 0, 0, lineNumber)) return false;
+            continue;
+        }
+        if (tokens[0] == ".macro") {
+            if (tokens.size() < 2 || !macros.emplace(tokens[1], Macro{}).second) {
+                std::cerr << "Error: line " << lineNumber << ": missing or duplicate macro name" << std::endl;
+                return false;
+            }
+            defining = &macros[tokens[1]];
+            defining->params.assign(tokens.begin() + 2, tokens.end());
+            continue;
+        }
+        if (isSectionLine(tokens, "Begin", "Data")) { inData = true; inInstructions = false; continue; }
+        if (isSectionLine(tokens, "End", "Data")) { inData = false; continue; }
+        if (isSectionLine(tokens, "Begin", "Instruction")) { inInstructions = true; inData = false; continue; }
+        if (isSectionLine(tokens, "End", "Instruction")) { inInstructions = false; continue; }
+
+        // "name:" may be followed by a blank or directly by the next token
+        std::string_view label;
+        size_t colon = tokens[0].find(':');
+        if (colon != std::string_view::npos) {
+            label = tokens[0].substr(0, colon);
+            tokens[0].remove_prefix(colon + 1);
+            if (tokens[0].empty()) tokens.erase(tokens.begin());
+        }
+        if (inData) {
+            if (tokens.size() < 2) continue;
+            if (!label.empty() && !define(label, tokens[0], 0, 0, lineNumber)) return false;
+            data.push_back({tokens[0], tokens[1], lineNumber});
+        } else if (inInstructions) {
+            if (!label.empty()) pendingLabels.push_back(label);
+            long number = nextNumber;
+            if (!tokens.empty() && parseInteger(tokens[0], number)) tokens.erase(tokens.begin());
+            if (tokens.empty()) continue;  // Label for the next instruction
+            if (!place(number, tokens, lineNumber, 0)) return false;
+        }
+    }
+    if (defining) {
+        std::cerr << "Error: macro without .endm" << std::endl;
+        return false;
+    }
+    for (std::string_view label : pendingLabels) {
+        if (!define(label, {}, labelBase + nextNumber, 2, lineNumber)) return false;
+    }
+    return true;
+}
+
+// Number, SYMBOL, SYMBOL+k or SYMBOL-k
+bool Assembler::resolve(std::string_view text, long& value, int depth) {
+    if (parseInteger(text, value)) return true;
+    long offset = 0;
+    std::string_view name = text;
+    size_t op = text.find_last_of("+-");
+    if (op != std::string_view::npos && op > 0) {
+        if (!parseInteger(text.substr(op + 1), offset)) return false;
+        if (text[op] == '-') offset = -offset;
+        name = text.substr(0, op);
+    }
+    auto symbol = symbols.find(name);
+    if (symbol == symbols.end()) return false;
+    Symbol& s = symbol->second;
+    if (s.state == 1 || depth > (int)symbols.size()) {
+        std::cerr << "Error: symbol " << name << " is defined in terms of itself" << std::endl;
+        return false;
+    }
+    if (s.state == 0) {
+        s.state = 1;
+        bool resolved = resolve(s.expression, s.value, depth + 1);
+        s.state = resolved ? 2 : 0;
+        if (!resolved) return false;
+    }
+    value = s.value + offset;
+    return true;
+}
+
+static void appendNumber(std::string& output, long value) {
+    char buffer[24];
+    std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    output.append(buffer, result.ptr);
+}
+
+bool Assembler::secondPass(std::string& output) {
+    output.clear();
+    output.reserve((data.size() + instructions.size()) * 24 + 128);
+    output += "Begin Data Section\n";
+    for (const auto& entry : data) {
+        long address, value;
+        if (!resolve(entry.address, address) || !resolve(entry.value, value)) {
+            // The numeric loader skips lines it cannot read, so do the same
+            std::cerr << "Warning: line " << entry.line << ": unresolved data line skipped" << std::endl;
+            continue;
+        }
+        appendNumber(output, address);
+        output += ' ';
+        appendNumber(output, value);
+        output += '\n';
+    }
+    output += "End Data Section\nBegin Instruction Section\n";
+    for (const auto& instruction : instructions) {
+        // Left in the output it would be read as assembly source again
+        if (instruction.tokens[0].find(':') != std::string_view::npos) {
+            std::cerr << "Error: line " << instruction.line << ": invalid mnemonic " << instruction.tokens[0] << std::endl;
+            return false;
+        }
+        long params[2] = {0, 0};
+        // As with the numeric loader, an unreadable operand is 0 and so is
+        // every operand after it
+        for (size_t i = 1; i < instruction.tokens.size() && i <= 2; i++) {
+            if (!resolve(instruction.tokens[i], params[i - 1])) {
+                std::cerr << "Warning: line " << instruction.line << ": unknown symbol "
+                          << instruction.tokens[i] << " encoded as 0" << std::endl;
+                params[i - 1] = 0;
+                break;
+            }
+        }
+        appendNumber(output, instruction.number);
+        output += ' ';
+        output += instruction.tokens[0];
+        output += ' ';
+        appendNumber(output, params[0]);
+        output += ' ';
+        appendNumber(output, params[1]);
+        output += '\n';
+    }
+    output += "End Instruction Section\n";
+    return true;
+}
+
+bool assembleProgram(std::string_view source, long labelBase, std::string& output) {
+    Assembler assembler(labelBase);
+    return assembler.firstPass(source) && assembler.secondPass(output);
+}
@@ -0,0 +1,22 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <string>
+#include <string_view>
+
+// Two-pass assembler for GTU-C312 sources with symbols. On top of the
+// numeric program format it accepts
+//   .const NAME value              constants
+//   .macro NAME a b ... / .endm    macros, invoked like an instruction
+//   name: <address> <value>        data symbols (data section)
+//   name: [n] OP a b               labels (instruction numbers are optional,
+//                                  the blank after the colon too)
+// and operands written as SYMBOL, SYMBOL+k or SYMBOL-k. The result is the
+// plain numeric format read by CPU::loadProgramFromBuffer, so it encodes to
+// the same words. A label's value is labelBase + its instruction number.
+
+// True if source uses any of the above (files without them load as before)
+bool needsAssembly(std::string_view source);
+bool assembleProgram(std::string_view source, long labelBase, std::string& output);
+
+#endif // ASSEMBLER_H
@@ -1,23 +1,27 @@
 #include "CPU.h"
+#include "Assembler.h"
 #ifdef _WIN32
 #include <conio.h>  // For _getch() on Windows
 #else
 #include <termios.h>
 #include <unistd.h>
-#include <fcntl.h>
+#include <cerrno>
+#include <climits>
 #endif
 #include <sstream>
 #include <regex>
 #include <tuple>
 #include <iomanip>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <iterator>
+#include <atomic>
+#include <charconv>
+#include <memory>
+#include <thread>
 
-struct Instruction {
-    int opcode;
-    int param1;
-    int param2;
-};
-
-static Instruction decode(long value) {
+Instruction decodeInstruction(long value) {
     // Use 6 digits for opcode, 12 for param1, 12 for param2 (signed)
     int opcode = (int)(value / 1000000000000LL);
     int param1 = (int)((value / 1000000LL) % 1000000LL);
@@ -28,67 +32,234 @@ static Instruction decode(long value) {
     return {opcode, param1, param2};
 }
 
-static long encode(int opcode, int param1, int param2) {
+long encodeInstruction(int opcode, int param1, int param2) {
     // Store as: opcode(6) param1(6) param2(6)
     if (param1 < 0) param1 += 1000000;
     if (param2 < 0) param2 += 1000000;
     return (long)opcode * 1000000000000LL + (long)param1 * 1000000LL + (long)param2;
 }
 
-CPU::CPU() : memory(11000, 0), m_isHalted(false), isKernelMode(true), debugMode(0) {
+static const char* const OPCODE_NAMES[] = {
+    "", "SET", "CPY", "CPYI", "ADD", "ADDI", "SUBI", "JIF", "PUSH", "POP",
+    "CALL", "RET", "HLT", "USER", "SYSCALL", "BCPY", "BFIL", "BCMP"
+};
+static const int OPCODE_COUNT = sizeof(OPCODE_NAMES) / sizeof(OPCODE_NAMES[0]);
+
+int opcodeForMnemonic(const std::string& mnemonic) {
+    for (int op = 1; op < OPCODE_COUNT; op++) {
+        if (mnemonic == OPCODE_NAMES[op]) return op;
+    }
+    return 0;
+}
+
+static const char* stateName(ThreadState state) {
+    return state == READY ? "READY" :
+           state == RUNNING ? "RUNNING" :
+           state == BLOCKED ? "BLOCKED" : "TERMINATED";
+}
+
+CPU::CPU(size_t memorySize) : memory(memorySize, 0), m_isHalted(false), isKernelMode(true), debugMode(0),
+             currentThreadId(0), instructionCount(0), cycleCount(0), contextSwitches(0),
+             threadTableAddress(0), schedulerStarted(false), rescheduleRequested(false),
+             sliceStart(0), virtualMemory(false), stackWords(DEFAULT_STACK_WORDS), faultCounts{},
+             syscallCounts(MAX_SYSCALL_NUMBER + 1, 0), trapTaken(false), nextIoDue(LONG_MAX), interruptCount(0),
+             idleCycles(0), nextSharedPublish(0) {
     // Initialize memory with zeros
+    for (int op = 0; op <= MAX_OPCODE; op++) cycleCost[op] = 1;
+    // Block instructions pay per word, like a transfer from the disk
+    for (int op = 0; op <= MAX_OPCODE; op++) wordCost[op] = op >= 15 && op <= 17 ? 1 : 0;
+    initializeThreadTable();
 }
 
-void CPU::loadProgram(const std::string& filename) {
-    std::ifstream file(filename);
+bool CPU::loadProgram(const std::string& filename) {
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
     if (!file.is_open()) {
         std::cerr << "Error: Could not open file " << filename << std::endl;
-        return;
+        return false;
     }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    std::string source = std::move(contents).str();
+    file.close();
+    return loadProgramFromBuffer(source);
+}
 
-    std::string line;
-    bool inDataSection = false;
+static const char* const SECTION_MARKERS[] = {
+    "Begin Data Section", "End Data Section", "Begin Instruction Section", "End Instruction Section"
+};
+
+// Start of the next line (at or after pos) holding a section marker
+static size_t findSectionMarker(std::string_view source, size_t pos) {
+    while (true) {
+        size_t hit = source.find("Section", pos);
+        if (hit == std::string_view::npos) return source.size();
+        size_t lineStart = source.rfind('\n', hit);
+        lineStart = lineStart == std::string_view::npos ? 0 : lineStart + 1;
+        size_t lineEnd = source.find('\n', hit);
+        std::string_view line = source.substr(lineStart, lineEnd == std::string_view::npos ? std::string_view::npos : lineEnd - lineStart);
+        if (line[0] != '#') {
+            for (const char* marker : SECTION_MARKERS) {
+                if (line.find(marker) != std::string_view::npos) return lineStart;
+            }
+        }
+        pos = hit + 7;
+    }
+}
+
+static bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Parses one number the way operator>> does: leading blanks, optional sign
+template <typename T>
+static bool parseNumber(const char*& cursor, const char* end, T& value) {
+    while (cursor < end && isBlank(*cursor)) cursor++;
+    if (cursor < end && *cursor == '+') cursor++;
+    std::from_chars_result result = std::from_chars(cursor, end, value);
+    if (result.ec != std::errc()) return false;
+    cursor = result.ptr;
+    return true;
+}
+
+// Parses "<address> <value>" lines in text. Each address is claimed
+// atomically; only the first claimer writes it, later ones are reported
+// as duplicates and resolved by the caller.
+static void parseDataLines(std::string_view text, long* memory, long memorySize,
+                           std::atomic<unsigned char>* claimed,
+                           std::vector<long>& duplicates, std::vector<long>& outOfRange) {
+    const char* cursor = text.data();
+    const char* end = text.data() + text.size();
+    while (cursor < end) {
+        const char* eol = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+        if (!eol) eol = end;
+        const char* p = cursor;
+        cursor = eol + 1;
+        if (p == eol || *p == '#') continue;
+
+        int address; long value;
+        if (!parseNumber(p, eol, address) || !parseNumber(p, eol, value)) continue;
+        if (address < 0 || address >= memorySize) {
+            outOfRange.push_back(address);
+        } else if (claimed[address].exchange(1, std::memory_order_relaxed)) {
+            duplicates.push_back(address);
+        } else {
+            memory[address] = value;
+        }
+    }
+}
+
+void CPU::loadDataSection(std::string_view text) {
+    size_t workers = std::thread::hardware_concurrency();
+    if (workers == 0) workers = 1;
+    workers = std::min(workers, text.size() / PARALLEL_LOAD_MIN_BYTES + 1);
+
+    // Split at line boundaries into roughly equal chunks
+    std::vector<std::string_view> chunks;
+    size_t start = 0;
+    for (size_t i = 1; i <= workers && start < text.size(); i++) {
+        size_t stop = i == workers ? text.size() : text.size() * i / workers;
+        if (stop < start) stop = start;
+        stop = text.find('\n', stop);
+        stop = stop == std::string_view::npos ? text.size() : stop + 1;
+        chunks.push_back(text.substr(start, stop - start));
+        start = stop;
+    }
+
+    std::unique_ptr<std::atomic<unsigned char>[]> claimed(new std::atomic<unsigned char>[memory.size()]());
+    std::vector<std::vector<long>> duplicates(chunks.size()), outOfRange(chunks.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < chunks.size(); i++) {
+        threads.emplace_back(parseDataLines, chunks[i], memory.data(), (long)memory.size(), claimed.get(),
+                             std::ref(duplicates[i]), std::ref(outOfRange[i]));
+    }
+    if (!chunks.empty()) {
+        parseDataLines(chunks[0], memory.data(), (long)memory.size(), claimed.get(), duplicates[0], outOfRange[0]);
+    }
+    for (auto& thread : threads) thread.join();
+
+    for (const auto& addresses : outOfRange) {
+        for (long address : addresses) {
+            std::cerr << "Error: Data address out of memory bounds: " << address << std::endl;
+        }
+    }
+
+    // Duplicate addresses: replay just those lines in file order so the last one wins
+    std::vector<char> duplicated;
+    long duplicateCount = 0;
+    for (const auto& addresses : duplicates) {
+        for (long address : addresses) {
+            if (duplicated.empty()) duplicated.assign(memory.size(), 0);
+            duplicated[address] = 1;
+            duplicateCount++;
+        }
+    }
+    if (duplicateCount == 0) return;
+    std::cerr << "Warning: " << duplicateCount << " duplicate data address(es) in data section, last value wins" << std::endl;
+    const char* cursor = text.data();
+    const char* end = text.data() + text.size();
+    while (cursor < end) {
+        const char* eol = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+        if (!eol) eol = end;
+        const char* p = cursor;
+        cursor = eol + 1;
+        int address; long value;
+        if (p == eol || *p == '#' || !parseNumber(p, eol, address) || !parseNumber(p, eol, value)) continue;
+        if (address >= 0 && address < (long)memory.size() && duplicated[address]) {
+            if (debugMode > 0) {
+                std::cerr << "DEBUG: loadProgram - Duplicate data address " << address << " = " << value << std::endl;
+            }
+            memory[address] = value;
+        }
+    }
+}
+
+bool CPU::loadProgramFromBuffer(std::string_view source) {
+    // Sources with labels, symbols or macros are assembled to the numeric
+    // format first; instruction n is loaded at 100 + n
+    if (needsAssembly(source)) {
+        std::string assembled;
+        if (!assembleProgram(source, 100, assembled)) return false;
+        return loadNumericProgram(assembled);
+    }
+    return loadNumericProgram(source);
+}
+
+// The plain numeric format, loaded as is
+bool CPU::loadNumericProgram(std::string_view source) {
     bool inInstructionSection = false;
 
-    while (std::getline(file, line)) {
+    size_t pos = 0;
+    while (pos < source.size()) {
+        size_t eol = source.find('\n', pos);
+        if (eol == std::string_view::npos) eol = source.size();
+        std::string line(source.substr(pos, eol - pos));
+        pos = eol + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+
         if (line.empty() || line[0] == '#') continue;
         if (line.find("Begin Data Section") != std::string::npos) {
-            inDataSection = true; inInstructionSection = false; continue;
+            // Data lines are independent, hand the whole section over at once
+            size_t sectionEnd = findSectionMarker(source, std::min(pos, source.size()));
+            if (pos < sectionEnd) loadDataSection(source.substr(pos, sectionEnd - pos));
+            pos = sectionEnd;
+            inInstructionSection = false; continue;
         } else if (line.find("End Data Section") != std::string::npos) {
-            inDataSection = false; continue;
+            continue;
         } else if (line.find("Begin Instruction Section") != std::string::npos) {
-            inInstructionSection = true; inDataSection = false; continue;
+            inInstructionSection = true; continue;
         } else if (line.find("End Instruction Section") != std::string::npos) {
             inInstructionSection = false; continue;
         }
-        if (inDataSection) {
-            std::istringstream iss(line);
-            int address; long value;
-            if (iss >> address >> value) memory[address] = value;
-        } else if (inInstructionSection) {
+        if (inInstructionSection) {
             std::istringstream iss(line);
             int instructionNum; std::string opcode; int param1 = 0, param2 = 0;
             if (iss >> instructionNum >> opcode) {
                 if (!(iss >> param1)) param1 = 0;
                 if (!(iss >> param2)) param2 = 0;
-                int op = 0;
-                if (opcode == "SET") op = 1;
-                else if (opcode == "CPY") op = 2;
-                else if (opcode == "CPYI") op = 3;
-                else if (opcode == "ADD") op = 4;
-                else if (opcode == "ADDI") op = 5;
-                else if (opcode == "SUBI") op = 6;
-                else if (opcode == "JIF") op = 7;
-                else if (opcode == "PUSH") op = 8;
-                else if (opcode == "POP") op = 9;
-                else if (opcode == "CALL") op = 10;
-                else if (opcode == "RET") op = 11;
-                else if (opcode == "HLT") op = 12;
-                else if (opcode == "USER") op = 13;
-                else if (opcode == "SYSCALL") op = 14;
+                int op = opcodeForMnemonic(opcode);
                 // Write instructions starting from address 100
-                if (instructionNum + 100 < memory.size()) {
-                    long encoded_instruction = encode(op, param1, param2); // Store encoded value temporarily
+                if (instructionNum >= 0 && instructionNum + 100 < (long)memory.size()) {
+                    long encoded_instruction = encodeInstruction(op, param1, param2); // Store encoded value temporarily
                     int target_address = instructionNum + 100; // Store target address
                     memory[target_address] = encoded_instruction;
                     if (debugMode > 0) {
@@ -100,12 +271,57 @@ void CPU::loadProgram(const std::string& filename) {
             }
         }
     }
-    file.close();
     // Set initial Program Counter to the start of instructions (address 100)
     memory[0] = 100;
     if (debugMode > 0) {
         std::cerr << "DEBUG: After loadProgram - memory[0] (PC): " << memory[0] << std::endl;
     }
+    initializeThreadTable();
+    return true;
+}
+
+void CPU::reset() {
+    flushOutput();
+    std::fill(memory.begin(), memory.end(), 0);
+    m_isHalted = false;
+    isKernelMode = true;
+    currentThreadId = 0;
+    instructionCount = 0;
+    cycleCount = 0;
+    contextSwitches = 0;
+    interruptCount = 0;
+    idleCycles = 0;
+    std::fill(std::begin(faultCounts), std::end(faultCounts), 0);
+    std::fill(syscallCounts.begin(), syscallCounts.end(), 0);
+    trapTaken = false;
+    initializeThreadTable();
+}
+
+bool CPU::step() {
+    if (m_isHalted) return false;
+    execute();
+    return !m_isHalted;
+}
+
+long CPU::run(long maxSteps) {
+    long steps = 0;
+    while (!m_isHalted && (maxSteps < 0 || steps < maxSteps)) {
+        execute();
+        steps++;
+    }
+    return steps;
+}
+
+bool CPU::readMemory(long address, std::span<long> out) const {
+    if (address < 0 || address + (long)out.size() > (long)memory.size()) return false;
+    std::copy_n(memory.begin() + address, out.size(), out.begin());
+    return true;
+}
+
+bool CPU::writeMemory(long address, std::span<const long> in) {
+    if (address < 0 || address + (long)in.size() > (long)memory.size()) return false;
+    std::copy(in.begin(), in.end(), memory.begin() + address);
+    return true;
 }
 
 void CPU::execute() {
@@ -114,8 +330,27 @@ void CPU::execute() {
     }
     if (m_isHalted) return;
 
+    if (scheduler && !schedulerStarted) {
+        startScheduling();
+        if (m_isHalted) return;
+    }
+
     executeInstruction();
 
+    if (cycleCount >= nextIoDue && !m_isHalted) {
+        serviceInterrupts();
+    }
+
+    if (scheduler && !m_isHalted &&
+        (rescheduleRequested || cycleCount - sliceStart >= scheduler->quantumFor(currentThreadId))) {
+        scheduleNextThread();
+    }
+
+    // Keep program output in step with the per-instruction trace
+    if (debugMode > 0) {
+        console.flushAll();
+    }
+
     // Handle debug output
     if (debugMode == 1) {
         printMemoryState();
@@ -124,9 +359,34 @@ void CPU::execute() {
         printMemoryState();
         waitForKeyPress();
     }
+
+    if (sharedSegment && (instructionCount >= nextSharedPublish || m_isHalted)) {
+        publishShared();
+    }
 }
 
+// Default memory model: no cache between the interpreter and memory, the
+// hooks return constant 0 and compile away
+struct FlatMemory {
+    long read(int, long) { return 0; }
+    long write(int, long) { return 0; }
+    long readRange(int, long, long) { return 0; }
+    long writeRange(int, long, long) { return 0; }
+};
+
 void CPU::executeInstruction() {
+#ifdef GTUSIM_CACHE_MODEL
+    if (cache) {
+        executeInstructionWith(*cache);
+        return;
+    }
+#endif
+    FlatMemory flat;
+    executeInstructionWith(flat);
+}
+
+template <typename MemoryModel>
+void CPU::executeInstructionWith(MemoryModel& model) {
     // Read the current Program Counter address from memory[0]
     long pc_address = memory[0];
     bool pc_was_set_manually_in_this_instruction = false;  // Declare at the start of function
@@ -135,22 +395,21 @@ void CPU::executeInstruction() {
         std::cerr << "--- Execute Start --- PC Address: " << pc_address << std::endl;
     }
 
-    // Added debug check for corrupted PC
-    if (pc_address == 1000021000007LL) { // Check if PC is the encoded value of SET 21 7
-        std::cerr << "FATAL ERROR: Program Counter corrupted! PC is the encoded value of the first instruction." << std::endl;
-        m_isHalted = true; // Halt the simulator
-        return; // Stop execution immediately
+    // Without a host scheduler the running thread is the one owning the PC
+    if (!scheduler && pc_address >= 0 && pc_address < (long)memory.size()) {
+        switchToThread(threadForAddress(pc_address));
     }
 
     // Check if the PC address is valid
-    if (pc_address < 0 || pc_address >= (long)memory.size()) {
-        m_isHalted = true;
-        std::cerr << "Invalid PC Address: " << pc_address << std::endl;
+    long pc_physical = pc_address;
+    if (!translateFetch(pc_physical)) {
+        raiseFault(FAULT_INVALID_PC);
+        trapTaken = false;
         return;
     }
-    
+
     // Read the raw instruction from the memory address indicated by the PC
-    long raw = memory[pc_address]; // Talimatı PC adresinden oku (Örn: memory[100])
+    long raw = memory[pc_physical]; // Talimatı PC adresinden oku (Örn: memory[100])
     if (debugMode > 1) {  // This is a debug message
         std::cerr << "DEBUG: Raw instruction at PC Address " << pc_address << ": " << raw << std::endl;
     }
@@ -158,8 +417,18 @@ void CPU::executeInstruction() {
     memory[3]++; // Increment instruction counter
 
     // Decode the raw instruction
-    Instruction inst = decode(raw);
+    Instruction inst = decodeInstruction(raw);
     int opcode = inst.opcode, param1 = inst.param1, param2 = inst.param2;
+
+    // Charge the instruction to the running thread
+    instructionCount++;
+    threadTable[currentThreadId].instructions++;
+    cycleCount += (opcode >= 0 && opcode <= MAX_OPCODE) ? cycleCost[opcode] : 1;
+
+    // Memory model hooks, stall cycles are charged to the instruction
+    auto read = [&](long address) { cycleCount += model.read(currentThreadId, address); };
+    auto write = [&](long address) { cycleCount += model.write(currentThreadId, address); };
+    read(pc_physical);
     if (debugMode > 0) {  // Keep this for execution info
         std::cerr << "PC Address=" << pc_address << ": opcode=" << opcode << ", p1=" << param1 << ", p2=" << param2 << std::endl;
     }
@@ -172,14 +441,23 @@ void CPU::executeInstruction() {
         }
     }
 
+    // Operand addresses, translated to physical words before each access
+    long addr1 = param1, addr2 = param2;
+    auto physical = [&](const std::span<long>& range) { return (long)(range.data() - memory.data()); };
+    auto valid = [&](long& address) {
+        if (translateAddress(address)) return true;
+        raiseFault(FAULT_INVALID_ACCESS);
+        return false;
+    };
+
     // Execute the instruction
     switch (opcode) {
-        case 1: if (isMemoryAccessValid(param2)) memory[param2] = param1; break;
-        case 2: if (isMemoryAccessValid(param1) && isMemoryAccessValid(param2)) memory[param2] = memory[param1]; break;
-        case 3: if (isMemoryAccessValid(param1) && isMemoryAccessValid(param2)) { long ind = memory[param1]; if (isMemoryAccessValid(ind)) memory[param2] = memory[ind]; } break;
-        case 4: if (isMemoryAccessValid(param1)) memory[param1] += param2; break;
-        case 5: if (isMemoryAccessValid(param1) && isMemoryAccessValid(param2)) memory[param1] += memory[param2]; break;
-        case 6: if (isMemoryAccessValid(param1) && isMemoryAccessValid(param2)) memory[param2] = memory[param1] - memory[param2]; break;
+        case 1: if (valid(addr2)) { write(addr2); memory[addr2] = param1; } break;
+        case 2: if (valid(addr1) && valid(addr2)) { read(addr1); write(addr2); memory[addr2] = memory[addr1]; } break;
+        case 3: if (valid(addr1) && valid(addr2)) { read(addr1); long ind = memory[addr1]; if (valid(ind)) { read(ind); write(addr2); memory[addr2] = memory[ind]; } } break;
+        case 4: if (valid(addr1)) { read(addr1); write(addr1); memory[addr1] += param2; } break;
+        case 5: if (valid(addr1) && valid(addr2)) { read(addr2); read(addr1); write(addr1); memory[addr1] += memory[addr2]; } break;
+        case 6: if (valid(addr1) && valid(addr2)) { read(addr1); read(addr2); write(addr2); memory[addr2] = memory[addr1] - memory[addr2]; } break;
         case 7: {
             if (debugMode > 1) {
                 std::cerr << "DEBUG: JIF instruction at PC=" << memory[0] << std::endl;
@@ -187,7 +465,7 @@ void CPU::executeInstruction() {
             }
             
             // First check if memory access is valid
-            if (!isMemoryAccessValid(param1)) {
+            if (!valid(addr1)) {
                 if (debugMode > 1) {
                     std::cerr << "DEBUG: JIF - Invalid memory access at address: " << param1 << std::endl;
                 }
@@ -195,7 +473,8 @@ void CPU::executeInstruction() {
             }
             
             // Get the condition value
-            long condition = memory[param1];
+            read(addr1);
+            long condition = memory[addr1];
             if (debugMode > 1) {
                 std::cerr << "DEBUG: JIF - Condition value at memory[" << param1 << "] = " << condition << std::endl;
                 std::cerr << "DEBUG: JIF - Target address if condition met: " << param2 << std::endl;
@@ -210,7 +489,7 @@ void CPU::executeInstruction() {
             }
             
             // Check if target address is within loaded instruction bounds
-            if (param2 >= memory.size()) {
+            if (!translateFetch(addr2)) {
                 if (debugMode > 1) {
                     std::cerr << "DEBUG: JIF - Target address out of memory bounds: " << param2 << std::endl;
                 }
@@ -218,69 +497,279 @@ void CPU::executeInstruction() {
             }
             
             // Check if target address contains a valid instruction (opcode != 0)
-            Instruction target_inst = decode(memory[param2]);
+            Instruction target_inst = decodeInstruction(memory[addr2]);
             if (target_inst.opcode == 0) {
-                std::cerr << "DEBUG: JIF - Target address (" << param2 << ") does not contain a valid instruction!" << std::endl;
+                if (debugMode > 1) {
+                    std::cerr << "DEBUG: JIF - Target address (" << param2 << ") does not contain a valid instruction!" << std::endl;
+                }
                 break;
             }
             
             if (condition <= 0) {
-                std::cerr << "DEBUG: JIF - Condition met (value <= 0). Jumping to address " << param2 << std::endl;
                 memory[0] = param2;  // Set PC to target address
                 pc_was_set_manually_in_this_instruction = true;
-                std::cerr << "DEBUG: JIF - PC set to " << memory[0] << std::endl;
+                if (debugMode > 1) {
+                    std::cerr << "DEBUG: JIF - Condition met (value <= 0). PC set to " << memory[0] << std::endl;
+                }
                 return;  // Exit immediately after setting PC
-            } else {
+            } else if (debugMode > 1) {
                 std::cerr << "DEBUG: JIF - Condition not met (value > 0). Continuing to next instruction." << std::endl;
             }
             break;
         }
-        case 8: if (isMemoryAccessValid(param1)) { memory[1]--; if (isMemoryAccessValid(memory[1])) memory[memory[1]] = memory[param1]; } break; // PC increment below
-        case 9: if (isMemoryAccessValid(param1) && isMemoryAccessValid(memory[1])) { memory[param1] = memory[memory[1]]; memory[1]++; } break; // PC increment below
-        case 10: handleCall(param1); break;  // CALL
-        case 11: handleRet(); break;         // RET
-        case 12: m_isHalted = true; std::cerr << "HLT instruction encountered." << std::endl; break; // HLT sets isHalted, preventing PC increment below
+        // Stack instructions: SP points at the top element and the stack
+        // grows down. Each checks the running thread's segment with one compare.
+        case 8: { // PUSH
+            long slot = stackSlot(memory[SP] - 1);
+            if (slot < 0) raiseFault(FAULT_STACK_OVERFLOW);
+            else if (valid(addr1)) { read(addr1); write(slot); memory[slot] = memory[addr1]; memory[SP]--; }
+            break;
+        }
+        case 9: { // POP
+            long slot = stackSlot(memory[SP]);
+            if (slot < 0) raiseFault(FAULT_STACK_UNDERFLOW);
+            else if (valid(addr1)) { read(slot); write(addr1); memory[addr1] = memory[slot]; memory[SP]++; }
+            break;
+        }
+        case 10: { // CALL
+            long slot = stackSlot(memory[SP] - 1);
+            if (slot < 0) { raiseFault(FAULT_STACK_OVERFLOW); break; }
+            write(slot);
+            memory[slot] = memory[PC] + 1;  // Save return address
+            memory[SP]--;
+            memory[PC] = param1;
+            pc_was_set_manually_in_this_instruction = true;
+            break;
+        }
+        case 11: { // RET
+            long slot = stackSlot(memory[SP]);
+            if (slot < 0) { raiseFault(FAULT_STACK_UNDERFLOW); break; }
+            read(slot);
+            memory[PC] = memory[slot];  // Restore return address
+            memory[SP]++;
+            pc_was_set_manually_in_this_instruction = true;
+            break;
+        }
+        case 12: m_isHalted = true; console.flushAll(); std::cerr << "HLT instruction encountered." << std::endl; break; // HLT sets isHalted, preventing PC increment below
         case 13: isKernelMode = false; std::cerr << "Switched to User Mode" << std::endl; break;
         case 14: {
             handleSyscall(param1, param2);
             break;
         }
+        // Block instructions: the whole range is validated once, then moved in bulk
+        case 15: { // BCPY A1 A2 - copy memory[BLOCK_LEN] words from A1 to A2
+            std::span<long> src, dst;
+            if (!mapRange(param1, memory[BLOCK_LEN], src) || !mapRange(param2, memory[BLOCK_LEN], dst)) {
+                raiseFault(FAULT_INVALID_ACCESS);
+            } else if (!src.empty()) {
+                cycleCount += wordCost[opcode] * (long)src.size();
+                cycleCount += model.readRange(currentThreadId, physical(src), src.size());
+                cycleCount += model.writeRange(currentThreadId, physical(dst), dst.size());
+                std::memmove(dst.data(), src.data(), src.size_bytes());
+            }
+            break;
+        }
+        case 16: { // BFIL A B - fill memory[BLOCK_LEN] words from A with value B
+            std::span<long> dst;
+            if (!mapRange(param1, memory[BLOCK_LEN], dst)) {
+                raiseFault(FAULT_INVALID_ACCESS);
+            } else {
+                cycleCount += wordCost[opcode] * (long)dst.size();
+                cycleCount += model.writeRange(currentThreadId, physical(dst), dst.size());
+                std::fill(dst.begin(), dst.end(), (long)param2);
+            }
+            break;
+        }
+        case 17: { // BCMP A1 A2 - memory[A1 - 1] = RESULT = -1, 0 or 1 comparing memory[BLOCK_LEN] words
+            // The result slot is mapped with A1's block, so user threads can read it
+            std::span<long> a, b;
+            long count = memory[BLOCK_LEN];
+            if (count < 0 || count >= (long)memory.size() || !mapRange(param1 - 1, count + 1, a) ||
+                !mapRange(param2, count, b)) {
+                raiseFault(FAULT_INVALID_ACCESS);
+            } else {
+                long& result = a[0];
+                a = a.subspan(1);
+                cycleCount += wordCost[opcode] * (long)a.size();
+                cycleCount += model.readRange(currentThreadId, physical(a), a.size());
+                cycleCount += model.readRange(currentThreadId, physical(b), b.size());
+                auto diff = std::mismatch(a.begin(), a.end(), b.begin());
+                result = diff.first == a.end() ? 0 : (*diff.first < *diff.second ? -1 : 1);
+                write(physical(a) - 1);
+                memory[RESULT] = result;
+            }
+            break;
+        }
         default: {
             if (debugMode > 1) {
                 std::cerr << "Unknown instruction: " << opcode << std::endl;
             }
-            m_isHalted = true;
+            raiseFault(FAULT_INVALID_OPCODE);
             break;
         }
     }
 
-    // Increment PC unless it was set manually in this instruction
-    if (!pc_was_set_manually_in_this_instruction) {
+    // Increment PC unless it was set manually in this instruction or a trap moved it
+    if (!pc_was_set_manually_in_this_instruction && !trapTaken) {
         memory[0]++;
     }
+    trapTaken = false;
 }
 
 void CPU::handleSyscall(int syscallType, long param) {
+    if (syscallType >= 0 && syscallType <= MAX_SYSCALL_NUMBER) syscallCounts[syscallType]++;
+    // Embedders get the first look at every system call
+    if (syscallHook && syscallHook(*this, syscallType, param)) {
+        logHostResult();
+        return;
+    }
+    // Registered host syscalls take precedence over the built-in ones
+    if ((unsigned)syscallType < hostSyscalls.size() && hostSyscalls[syscallType]) {
+        hostSyscalls[syscallType](*this, param);
+        logHostResult();
+        return;
+    }
+
     switch (syscallType) {
         case 1: { // PRN
             if (debugMode > 1) {  // This is a debug message
                 std::cerr << "DEBUG: SYSCALL PRN (C++ part) executed." << std::endl;
             }
-            std::cout << param << std::endl;
+            console.write(currentThreadId, param);
             break;
         }
         case 2: { // HLT
             if (debugMode > 0) {  // Keep this for execution info
                 std::cerr << "HLT instruction encountered." << std::endl;
             }
-            m_isHalted = true;
+            console.flush(currentThreadId);
+            setThreadState(currentThreadId, TERMINATED);
+            // With a host scheduler only the calling thread ends
+            if (scheduler) rescheduleRequested = true;
+            else m_isHalted = true;
             break;
         }
         case 3: { // YIELD
             if (debugMode > 1) {  // This is a debug message
                 std::cerr << "DEBUG: SYSCALL YIELD (C++ part) called." << std::endl;
             }
-            // YIELD implementation
+            // The switch happens after the PC has moved past the SYSCALL
+            if (scheduler) rescheduleRequested = true;
+            break;
+        }
+        case 4: { // SEND A - queue memory[A + 1] for thread memory[A]; memory[A + 2] = RESULT = status
+            std::span<long> block;
+            if (!mapRange(param, 3, block)) {
+                memory[RESULT] = -1;
+                break;
+            }
+            long target = block[0];
+            long status = -1;  // Invalid or ended thread, or a full mailbox
+            if (target >= 0 && target < (long)threadTable.size() && threadTable[target].state != TERMINATED) {
+                Thread& receiver = threadTable[target];
+                if (receiver.receiveBlock >= 0) {
+                    // Hand the message straight to a thread blocked in RECV
+                    memory[receiver.receiveBlock] = currentThreadId;
+                    memory[receiver.receiveBlock + 1] = block[1];
+                    memory[receiver.receiveBlock + 2] = 0;
+                    receiver.registers[SAVED_RESULT] = 0;
+                    receiver.receiveBlock = -1;
+                    setThreadState((int)target, READY);
+                    status = 0;
+                } else if (mailboxes[target].push(currentThreadId, block[1])) {
+                    status = 0;
+                }
+            }
+            block[2] = status;
+            memory[RESULT] = status;
+            break;
+        }
+        case 5: { // RECV A - memory[A] = sender, memory[A + 1] = value of the oldest message, memory[A + 2] = RESULT = status
+            std::span<long> block;
+            long sender, value;
+            if (!mapRange(param, 3, block)) {
+                memory[RESULT] = -1;
+            } else if (mailboxes[currentThreadId].pop(sender, value)) {
+                block[0] = sender;
+                block[1] = value;
+                block[2] = 0;
+                memory[RESULT] = 0;
+            } else if (scheduler) {
+                // Sleep until a SEND fills the block; the PC is already past the SYSCALL
+                threadTable[currentThreadId].receiveBlock = block.data() - memory.data();
+                setThreadState(currentThreadId, BLOCKED);
+                rescheduleRequested = true;
+            } else {
+                // The OS schedules itself and cannot be told to wait: poll
+                block[0] = -1;
+                block[2] = -1;
+                memory[RESULT] = -1;
+            }
+            break;
+        }
+        case 6:   // SEM_CREATE A - semaphore with value memory[A]; memory[A + 1] = RESULT = id
+        case 9: { // MUTEX_CREATE A - unlocked mutex; memory[A + 1] = RESULT = id
+            std::span<long> block;
+            if (!mapRange(param, 2, block)) {
+                memory[RESULT] = -1;
+                break;
+            }
+            if (syncObjects.size() >= MAX_SYNC_OBJECTS || (syscallType == 6 && block[0] < 0)) {
+                block[1] = -1;
+                memory[RESULT] = -1;
+                break;
+            }
+            bool mutex = syscallType == 9;
+            syncObjects.push_back({mutex, mutex ? 1 : block[0], -1, {}});
+            block[1] = (long)syncObjects.size() - 1;
+            memory[RESULT] = block[1];
+            break;
+        }
+        case 7: { // WAIT A - down / lock object memory[A]; memory[A + 1] = RESULT = status
+            std::span<long> block;
+            if (!mapRange(param, 2, block)) memory[RESULT] = -1;
+            else syncWait(block);
+            break;
+        }
+        case 8: { // POST A - up / unlock object memory[A]; memory[A + 1] = RESULT = status
+            std::span<long> block;
+            if (!mapRange(param, 2, block)) memory[RESULT] = -1;
+            else syncPost(block);
+            break;
+        }
+        case 15:   // DISK_READ A - block [offset, address, count, status]
+        case 16: { // DISK_WRITE A - same block, memory to disk
+            std::span<long> block, data;
+            if (!mapRange(param, 4, block)) {
+                memory[RESULT] = -1;
+                break;
+            }
+            // The offset is a guest word, keep its byte position inside a long
+            if (!disk.isOpen() || block[0] < 0 || !mapRange(block[1], block[2], data) ||
+                block[0] > BlockDevice::MAX_OFFSET - (long)data.size()) {
+                block[3] = -1;
+                memory[RESULT] = -1;
+                break;
+            }
+            long base = block.data() - memory.data();
+            queueIo({IO_DISK, syscallType == 16, currentThreadId, block[0], data.data() - memory.data(),
+                     (long)data.size(), -1, base + 3, 0}, disk.latency((long)data.size()));
+            break;
+        }
+        case 17: { // CONSOLE_READ A - block [address, count, status]; count becomes the words read
+            std::span<long> block, data;
+            if (!mapRange(param, 3, block)) {
+                memory[RESULT] = -1;
+                break;
+            }
+            if (!mapRange(block[0], block[1], data)) {
+                block[2] = -1;
+                memory[RESULT] = -1;
+                break;
+            }
+            long base = block.data() - memory.data();
+            queueIo({IO_CONSOLE, false, currentThreadId, 0, data.data() - memory.data(),
+                     (long)data.size(), base + 1, base + 2, 0}, consoleInput.latency());
             break;
         }
         default: {
@@ -292,15 +781,249 @@ void CPU::handleSyscall(int syscallType, long param) {
     }
 }
 
-bool CPU::isMemoryAccessValid(long address) {
-    if (address < 0 || address >= memory.size()) return false;
+// Status 0 once the thread holds the object. If it is taken, a thread
+// under a host scheduler queues up and blocks; without one it gets -1 and
+// polls. Locking a mutex it already holds is an error (-1).
+void CPU::syncWait(std::span<long> block) {
+    long id = block[0];
+    long status = -1;
+    if (id >= 0 && id < (long)syncObjects.size() &&
+        !(syncObjects[id].mutex && syncObjects[id].owner == currentThreadId)) {
+        SyncObject& object = syncObjects[id];
+        if (object.count > 0) {
+            object.count--;
+            if (object.mutex) object.owner = currentThreadId;
+            status = 0;
+        } else if (scheduler) {
+            // The PC is already past the SYSCALL; syncPost hands the object
+            // over and fills in the status
+            object.waiters.push_back({currentThreadId, block.data() - memory.data() + 1});
+            setThreadState(currentThreadId, BLOCKED);
+            rescheduleRequested = true;
+            return;
+        }
+    }
+    block[1] = status;
+    memory[RESULT] = status;
+}
+
+// Wakes the longest waiting thread, which then holds the object, or
+// releases it. Only the owner may unlock a mutex.
+void CPU::syncPost(std::span<long> block) {
+    long id = block[0];
+    if (id < 0 || id >= (long)syncObjects.size() ||
+        (syncObjects[id].mutex && syncObjects[id].owner != currentThreadId)) {
+        block[1] = -1;
+        memory[RESULT] = -1;
+        return;
+    }
+    SyncObject& object = syncObjects[id];
+    if (!object.waiters.empty()) {
+        Waiter next = object.waiters.front();
+        object.waiters.pop_front();
+        if (object.mutex) object.owner = next.threadId;
+        memory[next.statusAddress] = 0;
+        threadTable[next.threadId].registers[SAVED_RESULT] = 0;
+        setThreadState(next.threadId, READY);
+    } else {
+        object.count++;
+        if (object.mutex) object.owner = -1;
+    }
+    block[1] = 0;
+    memory[RESULT] = 0;
+}
+
+// A device serves its requests one at a time, so a request starts when the
+// one before it completes. Under a host scheduler the issuing thread blocks
+// until the interrupt; otherwise it keeps running and polls the status word.
+void CPU::queueIo(IoRequest request, long latency) {
+    std::deque<IoRequest>& queue = ioQueues[request.device];
+    request.due = (queue.empty() ? cycleCount : std::max(cycleCount, queue.back().due)) + latency;
+    memory[request.statusAddress] = 1;
+    queue.push_back(request);
+    nextIoDue = std::min(nextIoDue, queue.front().due);
+    memory[RESULT] = 0;
+    if (scheduler) {
+        setThreadState(currentThreadId, BLOCKED);
+        rescheduleRequested = true;
+    }
+}
+
+// Completion interrupts for every request that is due
+void CPU::serviceInterrupts() {
+    nextIoDue = LONG_MAX;
+    for (auto& queue : ioQueues) {
+        while (!queue.empty() && queue.front().due <= cycleCount) {
+            IoRequest request = queue.front();
+            queue.pop_front();
+            finishIo(request);
+        }
+        if (!queue.empty()) nextIoDue = std::min(nextIoDue, queue.front().due);
+    }
+}
+
+// The DMA transfer happens at completion, on physical memory
+void CPU::finishIo(const IoRequest& request) {
+    interruptCount++;
+    std::span<long> data(memory.data() + request.address, request.count);
+    bool ok = true;
+    long received = 0;  // Words that came in from the host
+    if (inputLog && inputLog->isReplay()) {
+        // The host devices are left alone, the log says what they delivered
+        if (!inputLog->replayIo(ok, data, received)) ok = false;
+    } else if (request.device == IO_DISK) {
+        ok = request.write ? disk.write(request.offset, data) : disk.read(request.offset, data);
+        received = request.write ? 0 : request.count;
+    } else {
+        received = consoleInput.read(data);
+    }
+    if (inputLog && !inputLog->isReplay()) {
+        inputLog->recordIo(ok, data.first(received));
+    }
+    if (request.device == IO_CONSOLE) {
+        memory[request.countAddress] = received;
+    }
+    memory[request.statusAddress] = ok ? 0 : -1;
+    if (debugMode > 0) {
+        std::cerr << "Interrupt: I/O for thread " << request.threadId << (ok ? " done" : " failed") << std::endl;
+    }
+    if (scheduler && threadTable[request.threadId].state == BLOCKED) {
+        setThreadState(request.threadId, READY);
+    }
+}
+
+// Host syscalls run outside the simulation, so their RESULT is an input
+void CPU::logHostResult() {
+    if (!inputLog) return;
+    if (inputLog->isReplay()) inputLog->replayResult(memory[RESULT]);
+    else inputLog->recordResult(memory[RESULT]);
+}
+
+bool CPU::recordInputs(const std::string& path) {
+    auto log = std::make_unique<InputLog>();
+    if (!log->create(path)) return false;
+    inputLog = std::move(log);
+    return true;
+}
+
+bool CPU::replayInputs(const std::string& path) {
+    auto log = std::make_unique<InputLog>();
+    if (!log->open(path)) return false;
+    inputLog = std::move(log);
+    return true;
+}
+
+bool CPU::finishInputLog() {
+    if (!inputLog) return true;
+    uint64_t hash = getMemoryHash();
+    if (!inputLog->isReplay()) {
+        inputLog->recordEnd(hash, instructionCount);
+        return true;
+    }
+    uint64_t recordedHash;
+    long recordedInstructions;
+    if (!inputLog->replayEnd(recordedHash, recordedInstructions)) return false;
+    std::ios::fmtflags flags = std::cerr.flags();
+    bool same = hash == recordedHash && instructionCount == recordedInstructions && !inputLog->hasFailed();
+    if (same) {
+        std::cerr << "Replay verified: memory hash " << std::hex << hash << std::dec
+                  << " after " << instructionCount << " instructions" << std::endl;
+    } else {
+        std::cerr << "Error: Replay diverged: memory hash " << std::hex << hash << std::dec << " after "
+                  << instructionCount << " instructions, recorded " << std::hex << recordedHash << std::dec
+                  << " after " << recordedInstructions << std::endl;
+    }
+    std::cerr.flags(flags);
+    return same;
+}
+
+uint64_t CPU::getMemoryHash() const {
+    uint64_t hash = 1469598103934665603ULL;
+    for (long word : memory) {
+        for (int i = 0; i < 8; i++) {
+            hash ^= (uint64_t)word >> (8 * i) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+bool CPU::registerSyscall(int number, HostSyscall handler) {
+    if (number < 0 || number > MAX_SYSCALL_NUMBER) {
+        std::cerr << "Error: System call number out of range: " << number << std::endl;
+        return false;
+    }
+    if ((size_t)number >= hostSyscalls.size()) {
+        hostSyscalls.resize(number + 1);
+    }
+    hostSyscalls[number] = std::move(handler);
+    return true;
+}
+
+void CPU::unregisterSyscall(int number) {
+    if (number >= 0 && (size_t)number < hostSyscalls.size()) {
+        hostSyscalls[number] = nullptr;
+    }
+}
+
+bool CPU::mapRange(long address, long count, std::span<long>& out) {
+    if (count < 0 || address < 0) return false;
+    if (usesPageTable()) {
+        long start = address;
+        if (!translatePage(start)) return false;
+        // The range is one span only if its pages sit in consecutive frames
+        // Compared as an offset from address, so a guest count cannot overflow
+        for (long page = address / PAGE_WORDS + 1; page * PAGE_WORDS - address < count; page++) {
+            long next = page * PAGE_WORDS;
+            if (!translatePage(next) || next != start + (page * PAGE_WORDS - address)) return false;
+        }
+        address = start;
+    } else if (!isKernelMode && address < 1000) {
+        return false;
+    }
+    if (address > (long)memory.size() || count > (long)memory.size() - address) return false;
+    out = std::span<long>(memory.data() + address, count);
+    return true;
+}
+
+// Checks a data access for the current mode and replaces a user-mode
+// virtual address with its physical word
+bool CPU::translateAddress(long& address) {
+    if (usesPageTable()) return translatePage(address);
+    if (address < 0 || address >= (long)memory.size()) return false;
     if (!isKernelMode && address < 1000) return false;
     return true;
 }
 
+// Instruction fetch: like translateAddress, but without virtual memory user
+// code may run anywhere (the OS drops to user mode inside its own region)
+bool CPU::translateFetch(long& address) {
+    if (usesPageTable()) return translatePage(address);
+    return address >= 0 && address < (long)memory.size();
+}
+
+bool CPU::translatePage(long& address) {
+    if (address < 0) return false;
+    long page = address / PAGE_WORDS;
+    Thread& thread = threadTable[currentThreadId];
+    TlbEntry& entry = tlb[page % TLB_ENTRIES];
+    if (entry.threadId == currentThreadId && entry.page == page) {
+        thread.tlbHits++;
+    } else {
+        thread.tlbMisses++;
+        if (page >= (long)thread.pageTable.size() || thread.pageTable[page] < 0) return false;
+        entry = {currentThreadId, page, thread.pageTable[page]};
+    }
+    address = entry.frame * PAGE_WORDS + address % PAGE_WORDS;
+    return true;
+}
+
 void CPU::printMemoryState() const {
     // Program sonuçlarını sadece CPU durduğunda ve combined.txt çalıştırıldığında göster
-    if ((debugMode == 0 || memory[0] == 0) && memory[100] == 1000021000007LL) {  // memory[100] == 1000021000007LL means combined.txt is running
+    // combined.txt is recognised by its code: SET 0 20 at 100 and its OS loop
+    // CPY 20 17 at 111 (test.txt shares the first instruction but not the loop)
+    bool combined = memory[100] == encodeInstruction(1, 0, 20) && memory[111] == encodeInstruction(2, 20, 17);
+    if ((debugMode == 0 || memory[0] == 0) && combined) {
         std::cout << "\nProgram Results:" << std::endl;
         std::cout << "----------------------------------------" << std::endl;
         
@@ -354,16 +1077,36 @@ void CPU::printMemoryState() const {
 }
 
 void CPU::waitForKeyPress() const {
+    int key;
+    if (inputLog && inputLog->isReplay()) {
+        inputLog->replayKey(key);
+        return;
+    }
     std::cerr << "Press any key to continue..." << std::endl;
 #ifdef _WIN32
-    _getch();
+    key = _getch();
 #else
-    int flags = fcntl(STDIN_FILENO, F_GETFL, 0);
-    fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK);
-    char c;
-    while (read(STDIN_FILENO, &c, 1) <= 0);
-    fcntl(STDIN_FILENO, F_SETFL, flags);
+    // Blocking read of one key with line buffering and echo off, so a
+    // paused CPU sleeps instead of spinning
+    struct termios saved;
+    bool terminal = tcgetattr(STDIN_FILENO, &saved) == 0;
+    if (terminal) {
+        struct termios raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+    char c = 0;
+    while (read(STDIN_FILENO, &c, 1) < 0 && errno == EINTR) {}
+    if (terminal) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    }
+    key = c;
 #endif
+    if (inputLog) {
+        inputLog->recordKey(key);
+    }
 }
 
 long CPU::getMemoryValue(int address) const {
@@ -394,27 +1137,530 @@ void CPU::switchToKernelMode() {
     std::cerr << "Switched to Kernel Mode" << std::endl;
 }
 
-void CPU::handleCall(long target) {
-    if (!isMemoryAccessValid(memory[SP])) {
-        std::cerr << "Error: Stack overflow in CALL" << std::endl;
-        m_isHalted = true;
+// Physical word of a stack slot, -1 outside the running thread's segment.
+// The unsigned compare covers both ends of the segment at once.
+long CPU::stackSlot(long address) {
+    Thread& thread = threadTable[currentThreadId];
+    // Without a host scheduler the program loads SP itself, so the segment
+    // ends at the SP of the thread's first stack instruction if it lies in
+    // the thread's own space
+    if (!thread.stackPlaced && !scheduler) {
+        long space = thread.baseAddress - thread.stackOffset;
+        if (memory[SP] >= space && memory[SP] <= space + 1000) setStackTop(thread, memory[SP]);
+        thread.stackPlaced = true;
+    }
+    if ((unsigned long)(address - thread.stackLimit) >= (unsigned long)(thread.stackTop - thread.stackLimit)) {
+        return -1;
+    }
+    return address + thread.stackOffset;
+}
+
+static const char* faultName(Fault cause) {
+    switch (cause) {
+        case FAULT_STACK_OVERFLOW: return "stack overflow";
+        case FAULT_STACK_UNDERFLOW: return "stack underflow";
+        case FAULT_INVALID_ACCESS: return "invalid memory access";
+        case FAULT_INVALID_OPCODE: return "invalid opcode";
+        case FAULT_INVALID_PC: return "invalid PC";
+        default: return "none";
+    }
+}
+
+// A user-mode fault traps to the OS handler at memory[TRAP_VECTOR] in kernel
+// mode. Without a handler (or on a fault in kernel mode) it ends the faulting
+// thread when the simulator schedules threads, otherwise the whole machine.
+// Invalid accesses that would halt the machine are ignored, as they always were.
+void CPU::raiseFault(Fault cause) {
+    faultCounts[cause]++;
+    long vector = memory[TRAP_VECTOR];
+    bool hasHandler = vector > 0 && vector < (long)memory.size() && !isKernelMode;
+    bool canKill = scheduler && currentThreadId != 0;
+    if (!hasHandler && !canKill && cause == FAULT_INVALID_ACCESS) {
+        if (debugMode > 1) {
+            std::cerr << "DEBUG: Invalid memory access ignored at PC " << memory[PC] << std::endl;
+        }
+        return;
+    }
+
+    if (hasHandler) {
+        memory[TRAP_CAUSE] = cause;
+        memory[TRAP_PC] = memory[PC];
+        memory[TRAP_THREAD] = currentThreadId;
+        if (debugMode > 0) {
+            std::cerr << "Trap: " << faultName(cause) << " in thread " << currentThreadId
+                      << " at PC " << memory[PC] << std::endl;
+        }
+        isKernelMode = true;
+        memory[PC] = vector;
+        trapTaken = true;
         return;
     }
-    memory[memory[SP]] = memory[PC] + 1;  // Save return address
-    memory[SP]--;  // Decrement stack pointer
-    memory[PC] = target;  // Set PC to target
+
+    // Running into a word that is not an instruction is how legacy programs end
+    if (canKill || cause != FAULT_INVALID_OPCODE) {
+        std::cerr << "Fault: " << faultName(cause) << " in thread " << currentThreadId
+                  << " at PC " << memory[PC] << std::endl;
+    }
+    console.flush(currentThreadId);
+    if (canKill) {
+        setThreadState(currentThreadId, TERMINATED);
+        rescheduleRequested = true;
+    } else {
+        m_isHalted = true;
+    }
+}
+
+// Threads own 1000-word regions starting at 1000 (see README memory layout);
+// everything below 1000 belongs to the OS (thread 0).
+int CPU::threadForAddress(long address) const {
+    if (address < 1000) return 0;
+    // An embedder's memory may end in a partial region, it belongs to the last thread
+    return (int)std::min(address / 1000, (long)threadTable.size() - 1);
+}
+
+void CPU::initializeThreadTable() {
+    threadTable.clear();
+    int count = (int)(memory.size() / 1000);
+    for (int id = 0; id < count; id++) {
+        Thread thread = {};
+        thread.id = id;
+        thread.startTime = -1;
+        thread.baseAddress = id * 1000;
+        thread.kernelMode = id == 0;
+        setupAddressSpace(thread);
+        thread.stateSince = cycleCount;
+        thread.receiveBlock = -1;
+        // A thread exists if anything was loaded into its region
+        bool loaded = id == 0;
+        for (long a = thread.baseAddress; !loaded && a < thread.baseAddress + 1000; a++) {
+            loaded = memory[a] != 0;
+        }
+        thread.state = loaded ? READY : TERMINATED;
+        long priorityAddress = threadTableAddress + (long)id * THREAD_ENTRY_SIZE + THREAD_PRIORITY_WORD;
+        if (threadTableAddress > 0 && priorityAddress < (long)memory.size()) {
+            thread.priority = (int)memory[priorityAddress];
+        }
+        threadTable.push_back(thread);
+    }
+    mailboxes.assign(threadTable.size(), Mailbox());
+    syncObjects.clear();
+    for (auto& queue : ioQueues) queue.clear();
+    nextIoDue = LONG_MAX;
+    currentThreadId = 0;
+    schedulerStarted = false;
+    rescheduleRequested = false;
+    tlb.assign(TLB_ENTRIES, TlbEntry{-1, -1, -1});
 }
 
-void CPU::handleRet() {
-    if (!isMemoryAccessValid(memory[SP] + 1)) {
-        std::cerr << "Error: Stack underflow in RET" << std::endl;
+// User threads map their region at USER_VIRTUAL_BASE, one frame per page.
+// The OS never translates, so its table stays empty. The stack segment is
+// mapped by its offset alone and does not go through the TLB.
+void CPU::setupAddressSpace(Thread& thread) {
+    long space = virtualMemory && thread.id > 0 ? USER_VIRTUAL_BASE : thread.baseAddress;
+    thread.pc = space + THREAD_CODE_OFFSET;
+    thread.sp = space + 999;
+    thread.stackOffset = thread.baseAddress - space;
+    thread.stackPlaced = false;
+    setStackTop(thread, thread.sp);
+    thread.pageTable.clear();
+    if (thread.id == 0) return;
+    long firstPage = USER_VIRTUAL_BASE / PAGE_WORDS;
+    thread.pageTable.assign(firstPage + 1000 / PAGE_WORDS, -1);
+    for (long page = 0; page < 1000 / PAGE_WORDS; page++) {
+        thread.pageTable[firstPage + page] = thread.baseAddress / PAGE_WORDS + page;
+    }
+}
+
+void CPU::setVirtualMemory(bool enabled) {
+    virtualMemory = enabled;
+    // Threads that have not run yet start in the new address space
+    for (auto& thread : threadTable) {
+        if (thread.startTime < 0) setupAddressSpace(thread);
+    }
+    tlb.assign(TLB_ENTRIES, TlbEntry{-1, -1, -1});
+}
+
+// The segment is the stackWords words below top, clipped to the thread's
+// own 1000-word space
+void CPU::setStackTop(Thread& thread, long top) {
+    thread.stackTop = top;
+    thread.stackLimit = std::max(thread.baseAddress - thread.stackOffset, top - stackWords);
+}
+
+bool CPU::setStackSize(long words) {
+    if (words <= 0 || words > 999 - THREAD_CODE_OFFSET) {
+        std::cerr << "Error: Stack size must be between 1 and " << 999 - THREAD_CODE_OFFSET << " words" << std::endl;
+        return false;
+    }
+    stackWords = words;
+    for (auto& thread : threadTable) {
+        setStackTop(thread, thread.stackTop);
+    }
+    return true;
+}
+
+bool CPU::mapPage(int threadId, long virtualPage, long frame) {
+    if (threadId <= 0 || threadId >= (int)threadTable.size() || virtualPage < 0 ||
+        frame < -1 || frame >= (long)(memory.size() / PAGE_WORDS)) {
+        return false;
+    }
+    std::vector<long>& pageTable = threadTable[threadId].pageTable;
+    if (virtualPage >= (long)pageTable.size()) pageTable.resize(virtualPage + 1, -1);
+    pageTable[virtualPage] = frame;
+    TlbEntry& entry = tlb[virtualPage % TLB_ENTRIES];
+    if (entry.threadId == threadId && entry.page == virtualPage) entry = TlbEntry{-1, -1, -1};
+    return true;
+}
+
+bool CPU::canRunNative() const {
+    bool cached = false;
+#ifdef GTUSIM_CACHE_MODEL
+    cached = cache != nullptr;
+#endif
+    return !scheduler && debugMode == 0 && !virtualMemory && !cached && !m_isHalted && nextIoDue == LONG_MAX;
+}
+
+// Same accounting as executeInstructionWith for natively run instructions;
+// the caller has already updated memory, INSTR_CNT and PC
+void CPU::retireNative(long pc, long instructions, long cycles) {
+    switchToThread(threadForAddress(pc));
+    cycleCount += cycles;
+    instructionCount += instructions;
+    threadTable[currentThreadId].instructions += instructions;
+    if (sharedSegment && instructionCount >= nextSharedPublish) {
+        publishShared();
+    }
+}
+
+bool CPU::shareMemory(const std::string& name) {
+    std::unique_ptr<SharedSegment> segment = createSharedSegment(name, memory.size());
+    if (!segment) return false;
+    memory = MemoryVector(memory.begin(), memory.end(), MemoryAllocator(segment->words(), memory.size()));
+    sharedSegment = std::move(segment);
+    publishShared();
+    return true;
+}
+
+void CPU::publishShared() {
+    SharedStatus status;
+    status.pc = memory[PC];
+    status.instructionCount = instructionCount;
+    status.cycleCount = cycleCount;
+    status.contextSwitches = contextSwitches;
+    status.currentThread = currentThreadId;
+    status.kernelMode = isKernelMode;
+    status.halted = m_isHalted;
+    status.threadCount = std::min((long)threadTable.size(), (long)SHARED_MAX_THREADS);
+    for (long i = 0; i < status.threadCount; i++) {
+        const Thread& thread = threadTable[i];
+        status.threads[i].state = thread.state;
+        status.threads[i].pc = thread.id == currentThreadId ? memory[PC] : thread.pc;
+        status.threads[i].instructions = thread.instructions;
+        status.threads[i].executionCount = thread.executionCount;
+    }
+    sharedSegment->publish(status);
+    nextSharedPublish = instructionCount + SHARED_PUBLISH_INTERVAL;
+}
+
+void CPU::printTlbReport(std::ostream& out) const {
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << "\nTLB Report (" << TLB_ENTRIES << " entries, " << PAGE_WORDS << "-word pages):" << std::endl;
+    out << "----------------------------------------" << std::endl;
+    out << std::setw(6) << "Thread" << std::setw(12) << "Hits" << std::setw(12) << "Misses"
+        << std::setw(10) << "Hit%" << std::endl;
+    for (const auto& thread : threadTable) {
+        long lookups = thread.tlbHits + thread.tlbMisses;
+        if (lookups == 0) continue;
+        out << std::setw(6) << thread.id << std::setw(12) << thread.tlbHits << std::setw(12) << thread.tlbMisses
+            << std::setw(9) << std::fixed << std::setprecision(1) << 100.0 * thread.tlbHits / lookups << "%" << std::endl;
+    }
+    out << "----------------------------------------" << std::endl;
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void CPU::setScheduler(std::unique_ptr<Scheduler> newScheduler) {
+    scheduler = std::move(newScheduler);
+    schedulerStarted = false;
+}
+
+bool CPU::setThreadPriority(int threadId, int priority) {
+    if (threadId < 0 || threadId >= (int)threadTable.size()) return false;
+    threadTable[threadId].priority = priority;
+    return true;
+}
+
+void CPU::startScheduling() {
+    scheduler->clear();
+    for (const auto& thread : threadTable) {
+        if (thread.state == RUNNING) setThreadState(thread.id, READY);
+        if (thread.state == READY) scheduler->add(thread.id, thread.priority);
+    }
+    schedulerStarted = true;
+    // No thread is RUNNING now, so nothing is saved before the first pick.
+    // The registers the program loaded belong to the thread that loaded it.
+    Thread& current = threadTable[currentThreadId];
+    for (int i = 0; i < SAVED_REGISTER_COUNT; i++) current.registers[i] = memory[SAVED_REGISTERS[i]];
+    scheduleNextThread();
+}
+
+void CPU::scheduleNextThread() {
+    bool quantumExpired = !rescheduleRequested;
+    rescheduleRequested = false;
+
+    Thread& current = threadTable[currentThreadId];
+    if (current.state == RUNNING || current.state == BLOCKED) {
+        current.pc = memory[PC];
+        current.sp = memory[SP];
+        current.kernelMode = isKernelMode;
+        for (int i = 0; i < SAVED_REGISTER_COUNT; i++) current.registers[i] = memory[SAVED_REGISTERS[i]];
+    }
+    if (current.state == RUNNING) {
+        if (quantumExpired) scheduler->onQuantumExpired(currentThreadId);
+        setThreadState(currentThreadId, READY);
+    }
+
+    int next = scheduler->pickNext();
+    // Nothing to run but I/O in flight: the CPU idles until the next interrupt
+    while (next < 0 && nextIoDue != LONG_MAX) {
+        idleCycles += nextIoDue - cycleCount;
+        cycleCount = nextIoDue;
+        serviceInterrupts();
+        next = scheduler->pickNext();
+    }
+    if (next < 0) {
+        bool deadlocked = std::any_of(threadTable.begin(), threadTable.end(),
+                                      [](const Thread& thread) { return thread.state == BLOCKED; });
+        if (deadlocked) {
+            std::cerr << "Deadlock: every remaining thread is blocked." << std::endl;
+        } else if (debugMode > 0) {
+            std::cerr << "All threads terminated." << std::endl;
+        }
         m_isHalted = true;
         return;
     }
-    memory[SP]++;  // Increment stack pointer
-    memory[PC] = memory[memory[SP]];  // Restore return address
+    if (next != currentThreadId) {
+        contextSwitches++;
+        if (debugMode > 0) {
+            std::cerr << "Context switch: thread " << currentThreadId << " -> thread " << next << std::endl;
+        }
+    }
+
+    currentThreadId = next;
+    Thread& thread = threadTable[next];
+    memory[PC] = thread.pc;
+    memory[SP] = thread.sp;
+    isKernelMode = thread.kernelMode;
+    for (int i = 0; i < SAVED_REGISTER_COUNT; i++) memory[SAVED_REGISTERS[i]] = thread.registers[i];
+    setThreadState(next, RUNNING);
+    sliceStart = cycleCount;
+}
+
+void CPU::switchToThread(int threadId) {
+    if (threadId != currentThreadId) {
+        if (threadTable[currentThreadId].state == RUNNING) {
+            setThreadState(currentThreadId, READY);
+        }
+        currentThreadId = threadId;
+        contextSwitches++;
+    }
+    if (threadTable[threadId].state != RUNNING) {
+        setThreadState(threadId, RUNNING);
+    }
+}
+
+// State time is accounted lazily: the interval since the last change is
+// added to the old state's bucket when the state changes.
+void CPU::setThreadState(int threadId, ThreadState state) {
+    Thread& thread = threadTable[threadId];
+    if (thread.state == state) return;
+    thread.stateCycles[thread.state] += cycleCount - thread.stateSince;
+    if (thread.state == RUNNING) {
+        writeThreadTableWord(threadId, THREAD_LAST_EXEC_WORD, cycleCount);
+    } else if (thread.state == BLOCKED) {
+        writeThreadTableWord(threadId, THREAD_BLOCKED_TIME_WORD, thread.stateCycles[BLOCKED]);
+    }
+    if (state == RUNNING) {
+        thread.executionCount++;
+        if (thread.startTime < 0) thread.startTime = cycleCount;
+    }
+    thread.state = state;
+    thread.stateSince = cycleCount;
+    if (state == READY && schedulerStarted) {
+        scheduler->add(threadId, thread.priority);
+    }
+}
+
+void CPU::writeThreadTableWord(int threadId, int word, long value) {
+    if (threadTableAddress <= 0) return;
+    long address = threadTableAddress + (long)threadId * THREAD_ENTRY_SIZE + word;
+    if (address < (long)memory.size()) memory[address] = value;
+}
+
+long CPU::getThreadCycles(int threadId, ThreadState state) const {
+    const Thread& thread = threadTable[threadId];
+    long cycles = thread.stateCycles[state];
+    if (thread.state == state) cycles += cycleCount - thread.stateSince;
+    return cycles;
+}
+
+void CPU::setCycleCost(int opcode, long cycles) {
+    if (opcode >= 0 && opcode <= MAX_OPCODE) cycleCost[opcode] = cycles;
 }
 
+long CPU::getCycleCost(int opcode) const {
+    return (opcode >= 0 && opcode <= MAX_OPCODE) ? cycleCost[opcode] : 1;
+}
+
+void CPU::setWordCost(int opcode, long cycles) {
+    if (opcode >= 0 && opcode <= MAX_OPCODE) wordCost[opcode] = cycles;
+}
+
+long CPU::getWordCost(int opcode) const {
+    return (opcode >= 0 && opcode <= MAX_OPCODE) ? wordCost[opcode] : 0;
+}
+
+// Cost file: one "<mnemonic or opcode> <cycles> [<cycles per word>]" entry
+// per line, # comments
+bool CPU::loadCycleCosts(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open cycle cost file " << filename << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream iss(line);
+        std::string name; long cycles;
+        if (!(iss >> name >> cycles)) continue;
+        int opcode = opcodeForMnemonic(name);
+        if (opcode == 0 && !name.empty() && std::isdigit((unsigned char)name[0])) {
+            opcode = std::stoi(name);
+        }
+        long perWord = wordCost[opcode < 0 || opcode > MAX_OPCODE ? 0 : opcode];
+        if (!(iss >> perWord)) iss.clear();
+        if (opcode <= 0 || opcode > MAX_OPCODE || cycles < 0 || perWord < 0) {
+            std::cerr << "Error: Invalid cycle cost entry: " << line << std::endl;
+            return false;
+        }
+        cycleCost[opcode] = cycles;
+        wordCost[opcode] = perWord;
+    }
+    return true;
+}
+
+void CPU::printCycleReport(std::ostream& out) const {
+    out << "\nCycle Report:" << std::endl;
+    out << "----------------------------------------" << std::endl;
+    out << "Total Cycles: " << cycleCount << ", Instructions: " << instructionCount
+        << ", Context Switches: " << contextSwitches << std::endl;
+    if (interruptCount > 0) {
+        out << "I/O Interrupts: " << interruptCount << ", Idle Cycles: " << idleCycles << std::endl;
+    }
+    out << std::setw(6) << "Thread" << std::setw(12) << "Instr" << std::setw(12) << "Running"
+        << std::setw(12) << "Ready" << std::setw(12) << "Blocked" << std::setw(10) << "Switches"
+        << std::setw(12) << "Start" << "  State" << std::endl;
+    for (const auto& thread : threadTable) {
+        // Skip regions that never held a thread
+        if (thread.startTime < 0 && thread.state == TERMINATED) continue;
+        out << std::setw(6) << thread.id << std::setw(12) << thread.instructions
+            << std::setw(12) << getThreadCycles(thread.id, RUNNING)
+            << std::setw(12) << getThreadCycles(thread.id, READY)
+            << std::setw(12) << getThreadCycles(thread.id, BLOCKED)
+            << std::setw(10) << thread.executionCount
+            << std::setw(12) << (thread.startTime < 0 ? std::string("-") : std::to_string(thread.startTime))
+            << "  " << stateName(thread.state) << std::endl;
+    }
+    out << "----------------------------------------" << std::endl;
+}
+
+long CPU::getSyscallCount(int syscallType) const {
+    if (syscallType < 0 || syscallType > MAX_SYSCALL_NUMBER) return 0;
+    return syscallCounts[syscallType];
+}
+
+// Fault names as report keys, e.g. "stack_overflow"
+static std::string faultKey(Fault cause) {
+    std::string key = faultName(cause);
+    for (auto& c : key) c = c == ' ' ? '_' : (char)std::tolower((unsigned char)c);
+    return key;
+}
+
+void CPU::printStats(std::ostream& out, StatsFormat format, double wallSeconds) const {
+    double ips = wallSeconds > 0 ? instructionCount / wallSeconds : 0;
+    std::vector<const Thread*> threads;
+    for (const auto& thread : threadTable) {
+        if (thread.startTime >= 0 || thread.state != TERMINATED) threads.push_back(&thread);
+    }
+
+    if (format == STATS_CSV) {
+        out << "metric,key,value" << std::endl;
+        out << "instructions,," << instructionCount << std::endl;
+        out << "cycles,," << cycleCount << std::endl;
+        out << "wall_seconds,," << wallSeconds << std::endl;
+        out << "instructions_per_second,," << (long)ips << std::endl;
+        out << "context_switches,," << contextSwitches << std::endl;
+        out << "interrupts,," << interruptCount << std::endl;
+        out << "idle_cycles,," << idleCycles << std::endl;
+        for (const Thread* thread : threads) {
+            out << "thread_instructions," << thread->id << "," << thread->instructions << std::endl;
+            out << "thread_running_cycles," << thread->id << "," << getThreadCycles(thread->id, RUNNING) << std::endl;
+            out << "thread_ready_cycles," << thread->id << "," << getThreadCycles(thread->id, READY) << std::endl;
+            out << "thread_blocked_cycles," << thread->id << "," << getThreadCycles(thread->id, BLOCKED) << std::endl;
+        }
+        for (int type = 0; type <= MAX_SYSCALL_NUMBER; type++) {
+            if (syscallCounts[type] > 0) out << "syscalls," << type << "," << syscallCounts[type] << std::endl;
+        }
+        for (int cause = FAULT_STACK_OVERFLOW; cause < FAULT_COUNT; cause++) {
+            out << "faults," << faultKey((Fault)cause) << "," << faultCounts[cause] << std::endl;
+        }
+        return;
+    }
+
+    out << "{" << std::endl;
+    out << "  \"instructions\": " << instructionCount << "," << std::endl;
+    out << "  \"cycles\": " << cycleCount << "," << std::endl;
+    out << "  \"wall_seconds\": " << wallSeconds << "," << std::endl;
+    out << "  \"instructions_per_second\": " << (long)ips << "," << std::endl;
+    out << "  \"context_switches\": " << contextSwitches << "," << std::endl;
+    out << "  \"interrupts\": " << interruptCount << "," << std::endl;
+    out << "  \"idle_cycles\": " << idleCycles << "," << std::endl;
+    out << "  \"threads\": [";
+    for (size_t i = 0; i < threads.size(); i++) {
+        const Thread* thread = threads[i];
+        out << (i ? "," : "") << std::endl << "    {\"id\": " << thread->id
+            << ", \"state\": \"" << stateName(thread->state) << "\""
+            << ", \"instructions\": " << thread->instructions
+            << ", \"running_cycles\": " << getThreadCycles(thread->id, RUNNING)
+            << ", \"ready_cycles\": " << getThreadCycles(thread->id, READY)
+            << ", \"blocked_cycles\": " << getThreadCycles(thread->id, BLOCKED)
+            << ", \"switches\": " << thread->executionCount << "}";
+    }
+    out << std::endl << "  ]," << std::endl;
+    out << "  \"syscalls\": {";
+    bool first = true;
+    for (int type = 0; type <= MAX_SYSCALL_NUMBER; type++) {
+        if (syscallCounts[type] == 0) continue;
+        out << (first ? "" : ", ") << "\"" << type << "\": " << syscallCounts[type];
+        first = false;
+    }
+    out << "}," << std::endl;
+    out << "  \"faults\": {";
+    for (int cause = FAULT_STACK_OVERFLOW; cause < FAULT_COUNT; cause++) {
+        out << (cause == FAULT_STACK_OVERFLOW ? "" : ", ") << "\"" << faultKey((Fault)cause) << "\": " << faultCounts[cause];
+    }
+    out << "}" << std::endl;
+    out << "}" << std::endl;
+}
+
+#ifdef GTUSIM_CACHE_MODEL
+void CPU::setCacheModel(std::unique_ptr<CacheHierarchy> model) {
+    cache = std::move(model);
+}
+#endif
+
 void CPU::printMemoryTrace() const {
     std::cerr << "\nMemory Trace:" << std::endl;
     std::cerr << "PC: " << memory[PC] << std::endl;
@@ -427,9 +1673,7 @@ void CPU::printMemoryTrace() const {
     std::cerr << "\nThread Table:" << std::endl;
     for (const auto& thread : threadTable) {
         std::cerr << "Thread " << thread.id << ": ";
-        std::cerr << "State=" << (thread.state == READY ? "READY" : 
-                                thread.state == RUNNING ? "RUNNING" :
-                                thread.state == BLOCKED ? "BLOCKED" : "TERMINATED");
+        std::cerr << "State=" << stateName(thread.state);
         std::cerr << ", PC=" << thread.pc;
         std::cerr << ", SP=" << thread.sp;
         std::cerr << ", Base=" << thread.baseAddress;
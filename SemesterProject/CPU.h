@@ -6,6 +6,19 @@
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <span>
+#include <string_view>
+#include <functional>
+#include <deque>
+#include "ConsoleOutput.h"
+#include "Devices.h"
+#include "InputLog.h"
+#include "Mailbox.h"
+#include "Scheduler.h"
+#include "SharedMemory.h"
+#ifdef GTUSIM_CACHE_MODEL
+#include "CacheModel.h"
+#endif
 
 enum ThreadState {
     READY,
@@ -20,6 +33,11 @@ enum Register {
     SP = 1,      // Stack Pointer
     RESULT = 2,  // System call result
     INSTR_CNT = 3, // Number of instructions executed
+    BLOCK_LEN = 4, // Word count for block instructions (BCPY, BFIL, BCMP)
+    TRAP_VECTOR = 5, // OS fault handler address (0: no handler)
+    TRAP_CAUSE = 6,  // Fault of the last trap
+    TRAP_PC = 7,     // PC of the faulting instruction
+    TRAP_THREAD = 8, // Thread that faulted
     SYSCALL_TYPE = 15, // System call type
     SYSCALL_PARAM = 16, // System call parameter
     SYSCALL_RESULT = 17, // System call result
@@ -28,49 +46,300 @@ enum Register {
     OS_STATE = 20 // OS state (0: IDLE, 1: RUNNING)
 };
 
+// Registers a thread keeps while the host scheduler has it switched out
+const int SAVED_REGISTERS[] = {RESULT, BLOCK_LEN, TRAP_CAUSE, TRAP_PC, TRAP_THREAD};
+const int SAVED_REGISTER_COUNT = sizeof(SAVED_REGISTERS) / sizeof(SAVED_REGISTERS[0]);
+const int SAVED_RESULT = 0;  // Index of RESULT in SAVED_REGISTERS
+
 struct Thread {
     int id;
-    long startTime;
-    long executionCount;
+    long startTime;       // Cycle the thread first ran (-1 if it never ran)
+    long executionCount;  // Number of times the thread was switched in
     ThreadState state;
     long pc;
     long sp;
     long baseAddress;  // Base address for thread's memory space
+    long instructions;    // Instructions executed by this thread
+    int priority;         // Higher runs first (priority scheduler) / more tickets (lottery)
+    bool kernelMode;      // Saved mode while the thread is switched out
+    long registers[SAVED_REGISTER_COUNT];  // Saved SAVED_REGISTERS, likewise
+    long stateSince;      // Cycle of the last state change
+    long stateCycles[4];  // Simulated cycles spent in each ThreadState
+    std::vector<long> pageTable;  // Virtual page -> physical frame, -1 = unmapped
+    long stackLimit;      // Lowest stack slot
+    long stackTop;        // Initial SP; slots are [stackLimit, stackTop)
+    long stackOffset;     // Added to a stack slot to get its physical word
+    bool stackPlaced;     // Segment moved to the program's SP (no host scheduler)
+    long tlbHits;
+    long tlbMisses;
+    long receiveBlock;    // Physical [sender, value, status] block of a blocked RECV, -1 = not waiting
 };
 
+// Layout of an entry in the OS thread table (see os.txt)
+const int THREAD_ENTRY_SIZE = 10;
+const int THREAD_LAST_EXEC_WORD = 7;
+const int THREAD_BLOCKED_TIME_WORD = 8;
+const int THREAD_PRIORITY_WORD = 9;
+// os.txt keeps the thread table address and the number of threads here
+const int OS_THREAD_TABLE_WORD = 22;
+const int OS_THREAD_COUNT_WORD = 23;
+
+// Threads start at the same offset in their region as the OS does in its own
+const int THREAD_CODE_OFFSET = 100;
+
+// Virtual memory: every user thread sees its own region at USER_VIRTUAL_BASE
+const int PAGE_WORDS = 100;
+const long USER_VIRTUAL_BASE = 1000;
+
+const int MAX_OPCODE = 31;
+
+// Faults raised by the interpreter
+enum Fault {
+    FAULT_NONE = 0,
+    FAULT_STACK_OVERFLOW = 1,
+    FAULT_STACK_UNDERFLOW = 2,
+    FAULT_INVALID_ACCESS = 3,
+    FAULT_INVALID_OPCODE = 4,
+    FAULT_INVALID_PC = 5,
+    FAULT_COUNT = 6
+};
+
+// Instruction word: opcode * 10^12 + param1 * 10^6 + param2, params signed
+struct Instruction {
+    int opcode;
+    int param1;
+    int param2;
+};
+
+Instruction decodeInstruction(long value);
+long encodeInstruction(int opcode, int param1, int param2);
+// Returns the opcode for a mnemonic, 0 if it is unknown
+int opcodeForMnemonic(const std::string& mnemonic);
+
 class CPU {
 public:
-    CPU();
-    void loadProgram(const std::string& filename);
+    // Called for every SYSCALL before the built-in handlers. Return true
+    // if the call was handled and the built-in handler should be skipped.
+    using SyscallHook = std::function<bool(CPU& cpu, int syscallType, long param)>;
+    // Host-implemented system call, registered by number
+    using HostSyscall = std::function<void(CPU& cpu, long param)>;
+    static const int MAX_SYSCALL_NUMBER = 1023;
+
+    static const size_t DEFAULT_MEMORY_SIZE = 11000;
+    // Data sections larger than this are parsed on several threads
+    static const size_t PARALLEL_LOAD_MIN_BYTES = 256 * 1024;
+
+    explicit CPU(size_t memorySize = DEFAULT_MEMORY_SIZE);
+    bool loadProgram(const std::string& filename);
+    bool loadProgramFromBuffer(std::string_view source);
+    // Loads an OS image and relocates each thread image into its own region
+    // (thread i at i * 1000), see Linker.cpp
+    bool linkProgram(const std::string& osFile, const std::vector<std::string>& threadFiles);
+    void reset();
     void execute();
+    bool step();                    // Execute one instruction, false once halted
+    long run(long maxSteps = -1);   // Run until halt or maxSteps, returns steps executed
     bool isHalted() const { return m_isHalted; }
     void setDebugMode(int mode) { debugMode = mode; }
-    const std::vector<long>& getMemory() const { return memory; }
+    const MemoryVector& getMemory() const { return memory; }
     void printMemoryState() const;
     void waitForKeyPress() const;
     long getMemoryValue(int address) const;
     void setMemoryValue(int address, long value);
+    size_t getMemorySize() const { return memory.size(); }
+    bool readMemory(long address, std::span<long> out) const;
+    bool writeMemory(long address, std::span<const long> in);
+    void setSyscallHook(SyscallHook hook) { syscallHook = std::move(hook); }
+    bool registerSyscall(int number, HostSyscall handler);
+    void unregisterSyscall(int number);
+    // Span over [address, address + count) if the current mode may access it
+    bool mapRange(long address, long count, std::span<long>& out);
+
+    // Simulated console output (PRN)
+    void setThreadOutputPrefix(const std::string& prefix) { console.setPerThreadFiles(prefix); }
+    void setOutputFlushThreshold(size_t bytes) { console.setFlushThreshold(bytes); }
+    void flushOutput() { console.flushAll(); }
+
+    // Simulated I/O devices (DISK_READ, DISK_WRITE, CONSOLE_READ). Requests
+    // complete after the device latency; the completion interrupt copies
+    // the data and wakes the issuing thread.
+    BlockDevice& getDisk() { return disk; }
+    ConsoleDevice& getConsoleInput() { return consoleInput; }
+    long getInterruptCount() const { return interruptCount; }
+    long getIdleCycles() const { return idleCycles; }  // Cycles with every thread waiting for I/O
+
+    // Record / replay of everything the host feeds in: device data, host
+    // syscall results and debug keypresses (see InputLog.h). A replay reads
+    // the log instead of the host devices and never waits for a key.
+    bool recordInputs(const std::string& path);
+    bool replayInputs(const std::string& path);
+    // Ends the log with the final memory hash, or checks it on replay
+    bool finishInputLog();
+    uint64_t getMemoryHash() const;  // FNV-1a over the memory words
+
+    // Cycle-cost model and per-thread simulated time
+    void setCycleCost(int opcode, long cycles);
+    long getCycleCost(int opcode) const;
+    // Extra cycles per word moved or compared by the block instructions
+    void setWordCost(int opcode, long cycles);
+    long getWordCost(int opcode) const;
+    bool loadCycleCosts(const std::string& filename);
+    long getCycleCount() const { return cycleCount; }
+    long getInstructionCount() const { return instructionCount; }
+    const std::vector<Thread>& getThreadTable() const { return threadTable; }
+    long getThreadCycles(int threadId, ThreadState state) const;
+    // Mirror last execution / blocked time into the OS thread table at address
+    void setThreadTableAddress(long address) { threadTableAddress = address; }
+    long getThreadTableAddress() const { return threadTableAddress; }
+    void printCycleReport(std::ostream& out) const;
+    long getContextSwitches() const { return contextSwitches; }
+    long getSyscallCount(int syscallType) const;
+
+    // Machine-readable run statistics (instructions, per-thread counts,
+    // context switches, syscalls by type, faults); wallSeconds is host time
+    enum StatsFormat { STATS_JSON, STATS_CSV };
+    void printStats(std::ostream& out, StatsFormat format, double wallSeconds) const;
+
+    // Host scheduling: with a scheduler set the simulator switches threads
+    // itself on YIELD, thread HLT and quantum expiry
+    void setScheduler(std::unique_ptr<Scheduler> newScheduler);
+    bool setThreadPriority(int threadId, int priority);
+
+    // Virtual memory: user-mode addresses go through the running thread's
+    // page table and a software TLB, kernel mode stays physical
+    static const int TLB_ENTRIES = 16;
+    // Semaphores and mutexes created with SEM_CREATE / MUTEX_CREATE
+    static const int MAX_SYNC_OBJECTS = 256;
+    // Stack segment: the top DEFAULT_STACK_WORDS words below each thread's
+    // initial SP. PUSH and CALL below it or POP and RET above it fault.
+    static const long DEFAULT_STACK_WORDS = 200;
+    bool setStackSize(long words);
+    long getFaultCount(Fault cause) const { return faultCounts[cause]; }
+    void setVirtualMemory(bool enabled);
+    bool isVirtualMemoryEnabled() const { return virtualMemory; }
+    bool mapPage(int threadId, long virtualPage, long frame);  // frame -1 unmaps
+    void printTlbReport(std::ostream& out) const;
+
+    // Native code (gtuc312-aot, see AotRuntime.h): compiled blocks may work
+    // on memory directly while nothing observes single instructions (no
+    // scheduler, debug mode, cache model or virtual memory). retireNative
+    // charges instructions run from pc to the thread owning pc, like the
+    // interpreter would.
+    bool canRunNative() const;
+    long* nativeMemory() { return memory.data(); }
+    bool isInKernelMode() const { return isKernelMode; }
+    void retireNative(long pc, long instructions, long cycles);
+
+    // Moves memory into the POSIX shared-memory segment name and publishes
+    // a status header there for gtutop (see SharedMemory.h)
+    bool shareMemory(const std::string& name);
+
+#ifdef GTUSIM_CACHE_MODEL
+    // Cache simulation between the interpreter and memory (nullptr = off)
+    void setCacheModel(std::unique_ptr<CacheHierarchy> model);
+    const CacheHierarchy* getCacheModel() const { return cache.get(); }
+#endif
 
 private:
-    std::vector<long> memory;  // Memory space
+    MemoryVector memory;  // Memory space, in sharedSegment if there is one
     bool m_isHalted;
     bool isKernelMode;
     int debugMode;
     std::vector<Thread> threadTable;
     int currentThreadId;
     long instructionCount;
+    long cycleCount;
+    long contextSwitches;
+    long cycleCost[MAX_OPCODE + 1];
+    long wordCost[MAX_OPCODE + 1];
+    long threadTableAddress;  // 0 = no OS thread table to mirror into
+    std::unique_ptr<Scheduler> scheduler;
+    bool schedulerStarted;
+    bool rescheduleRequested;
+    long sliceStart;          // Cycle the running thread was switched in
+    bool virtualMemory;
+    long stackWords;
+    long faultCounts[FAULT_COUNT];
+    std::vector<long> syscallCounts;  // Indexed by syscall type
+    bool trapTaken;           // A fault moved the PC to the trap vector
+    struct TlbEntry {
+        int threadId;  // Entries are tagged, so a switch needs no flush
+        long page;
+        long frame;
+    };
+    std::vector<TlbEntry> tlb;  // Direct-mapped, indexed by page % TLB_ENTRIES
+#ifdef GTUSIM_CACHE_MODEL
+    std::unique_ptr<CacheHierarchy> cache;
+#endif
+    ConsoleOutput console;
+    SyscallHook syscallHook;
+    std::vector<HostSyscall> hostSyscalls;  // Flat dispatch table indexed by syscall number
+    std::vector<Mailbox> mailboxes;   // Indexed by thread id
+    struct Waiter {
+        int threadId;
+        long statusAddress;       // Physical status word of the WAIT block
+    };
+    struct SyncObject {
+        bool mutex;
+        long count;               // Semaphore value; a mutex is 1 while unlocked
+        int owner;                // Thread holding a mutex, -1 = none
+        std::deque<Waiter> waiters;  // Blocked threads, woken in FIFO order
+    };
+    std::vector<SyncObject> syncObjects;  // Indexed by the id returned at creation
+    enum IoDevice { IO_DISK, IO_CONSOLE, IO_DEVICE_COUNT };
+    struct IoRequest {
+        IoDevice device;
+        bool write;
+        int threadId;
+        long offset;         // Disk word offset
+        long address;        // Physical memory the device transfers to or from
+        long count;
+        long countAddress;   // Physical word that gets the words read, -1 = none
+        long statusAddress;  // Physical status word: 1 busy, 0 done, -1 failed
+        long due;            // Completion cycle
+    };
+    BlockDevice disk;
+    ConsoleDevice consoleInput;
+    std::deque<IoRequest> ioQueues[IO_DEVICE_COUNT];  // FIFO per device
+    long nextIoDue;           // Earliest completion, LONG_MAX if nothing is pending
+    long interruptCount;
+    long idleCycles;
+    std::unique_ptr<InputLog> inputLog;
+    std::unique_ptr<SharedSegment> sharedSegment;
+    long nextSharedPublish;   // Instruction count of the next status publish
 
     // Helper functions
+    bool loadNumericProgram(std::string_view source);
+    void loadDataSection(std::string_view text);
     void executeInstruction();
+    template <typename MemoryModel> void executeInstructionWith(MemoryModel& model);
     void handleSyscall(int syscallType, long param);
-    bool isMemoryAccessValid(long address);
+    bool translateAddress(long& address);
+    bool translateFetch(long& address);
+    bool translatePage(long& address);
+    // The OS (thread 0) keeps physical addresses even when it drops to user mode
+    bool usesPageTable() const { return virtualMemory && !isKernelMode && currentThreadId != 0; }
+    void setupAddressSpace(Thread& thread);
+    void setStackTop(Thread& thread, long top);
+    long stackSlot(long address);
+    void raiseFault(Fault cause);
+    void startScheduling();
     void scheduleNextThread();
     void initializeThreadTable();
     void switchToUserMode();
     void switchToKernelMode();
-    void handleCall(long target);
-    void handleRet();
     void printMemoryTrace() const;
+    int threadForAddress(long address) const;
+    void switchToThread(int threadId);
+    void setThreadState(int threadId, ThreadState state);
+    void writeThreadTableWord(int threadId, int word, long value);
+    void publishShared();
+    void syncWait(std::span<long> block);
+    void syncPost(std::span<long> block);
+    void queueIo(IoRequest request, long latency);
+    void serviceInterrupts();
+    void finishIo(const IoRequest& request);
+    void logHostResult();
 };
 
 #endif // CPU_H 
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "CacheModel.h"
+#include "CPU.h"
+#include <iomanip>
+#include <sstream>
+
+static bool parseLevel(const std::string& text, CacheLevelConfig& level) {
+    char x1, x2;
+    std::istringstream iss(text);
+    if (!(iss >> level.sets >> x1 >> level.ways >> x2 >> level.lineWords) || x1 != 'x' || x2 != 'x') {
+        return false;
+    }
+    return level.sets > 0 && level.ways > 0 && level.lineWords > 0;
+}
+
+bool parseCacheSpec(const std::string& spec, CacheConfig& config) {
+    config.l1 = {64, 2, 4, 0};
+    config.l2 = {0, 0, 0, 10};
+    config.replacement = REPLACE_LRU;
+    config.writePolicy = WRITE_BACK;
+    config.memoryLatency = 100;
+
+    std::istringstream iss(spec);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        if (item.rfind("l1=", 0) == 0) {
+            if (!parseLevel(item.substr(3), config.l1)) return false;
+        } else if (item.rfind("l2=", 0) == 0) {
+            if (!parseLevel(item.substr(3), config.l2)) return false;
+        } else if (item == "lru") {
+            config.replacement = REPLACE_LRU;
+        } else if (item == "random") {
+            config.replacement = REPLACE_RANDOM;
+        } else if (item == "wb") {
+            config.writePolicy = WRITE_BACK;
+        } else if (item == "wt") {
+            config.writePolicy = WRITE_THROUGH;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+CacheLevel::CacheLevel(const CacheLevelConfig& config, Replacement replacement, unsigned seed)
+    : config(config), replacement(replacement),
+      tags(config.sets * config.ways, -1), lastUse(config.sets * config.ways, 0),
+      dirty(config.sets * config.ways, 0), clock(0), rng(seed) {
+}
+
+bool CacheLevel::access(long address, bool write, bool markDirty, long& evicted) {
+    evicted = -1;
+    long line = address / config.lineWords;
+    long set = line % config.sets;
+    long first = set * config.ways;
+    clock++;
+
+    for (int way = 0; way < config.ways; way++) {
+        if (tags[first + way] == line) {
+            lastUse[first + way] = clock;
+            if (write && markDirty) dirty[first + way] = 1;
+            return true;
+        }
+    }
+
+    // Miss: pick an invalid way first, then the policy's victim
+    long victim = -1;
+    for (int way = 0; way < config.ways && victim < 0; way++) {
+        if (tags[first + way] < 0) victim = first + way;
+    }
+    if (victim < 0) {
+        if (replacement == REPLACE_RANDOM) {
+            victim = first + (long)(rng() % config.ways);
+        } else {
+            victim = first;
+            for (int way = 1; way < config.ways; way++) {
+                if (lastUse[first + way] < lastUse[victim]) victim = first + way;
+            }
+        }
+        if (dirty[victim]) evicted = tags[victim] * config.lineWords;
+    }
+    tags[victim] = line;
+    lastUse[victim] = clock;
+    dirty[victim] = write && markDirty;
+    return false;
+}
+
+CacheHierarchy::CacheHierarchy(const CacheConfig& config)
+    : config(config), l1(config.l1, config.replacement, 1),
+      l2(config.l2.sets > 0 ? config.l2 : CacheLevelConfig{1, 1, 1, 0}, config.replacement, 2),
+      hasL2(config.l2.sets > 0) {
+}
+
+long CacheHierarchy::accessL2(CacheStats& threadStats, long address, bool write) {
+    if (!hasL2) {
+        return config.memoryLatency;
+    }
+    long evicted;
+    bool writeBack = config.writePolicy == WRITE_BACK;
+    if (l2.access(address, write, writeBack, evicted)) {
+        return config.l2.hitLatency;
+    }
+    threadStats.l2Misses++;
+    if (evicted >= 0) threadStats.writebacks++;
+    return config.l2.hitLatency + config.memoryLatency;
+}
+
+long CacheHierarchy::access(int threadId, long address, bool write) {
+    if (address <= OS_STATE) return 0;  // Memory-mapped registers live in the CPU
+    if ((size_t)threadId >= stats.size()) stats.resize(threadId + 1, CacheStats{});
+    CacheStats& threadStats = stats[threadId];
+    threadStats.accesses++;
+
+    long stall = config.l1.hitLatency;
+    long evicted;
+    bool writeBack = config.writePolicy == WRITE_BACK;
+    if (!l1.access(address, write, writeBack, evicted)) {
+        threadStats.l1Misses++;
+        stall += accessL2(threadStats, address, false);
+    }
+    if (evicted >= 0) {
+        threadStats.writebacks++;
+        accessL2(threadStats, evicted, true);
+    }
+    // Write-through: every store also goes to the next level (buffered, no stall)
+    if (write && !writeBack && hasL2) {
+        l2.access(address, true, false, evicted);
+    }
+    threadStats.stallCycles += stall;
+    return stall;
+}
+
+long CacheHierarchy::accessRange(int threadId, long address, long count, bool write) {
+    long stall = 0;
+    long lineWords = config.l1.lineWords;
+    for (long a = address; a < address + count; a = (a / lineWords + 1) * lineWords) {
+        stall += access(threadId, a, write);
+    }
+    return stall;
+}
+
+void CacheHierarchy::printReport(std::ostream& out) const {
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << "\nCache Report:" << std::endl;
+    out << "----------------------------------------" << std::endl;
+    out << "L1: " << config.l1.sets << " sets x " << config.l1.ways << " ways x " << config.l1.lineWords << " words";
+    if (hasL2) {
+        out << ", L2: " << config.l2.sets << " sets x " << config.l2.ways << " ways x " << config.l2.lineWords << " words";
+    }
+    out << ", " << (config.replacement == REPLACE_LRU ? "LRU" : "random")
+        << ", " << (config.writePolicy == WRITE_BACK ? "write-back" : "write-through") << std::endl;
+    out << std::setw(6) << "Thread" << std::setw(12) << "Accesses" << std::setw(12) << "L1 Miss"
+        << std::setw(10) << "L1 Hit%" << std::setw(12) << "L2 Miss" << std::setw(12) << "Writeback"
+        << std::setw(12) << "Stall" << std::endl;
+    for (size_t id = 0; id < stats.size(); id++) {
+        const CacheStats& s = stats[id];
+        if (s.accesses == 0) continue;
+        out << std::setw(6) << id << std::setw(12) << s.accesses << std::setw(12) << s.l1Misses
+            << std::setw(9) << std::fixed << std::setprecision(1)
+            << 100.0 * (s.accesses - s.l1Misses) / s.accesses << "%"
+            << std::setw(12) << s.l2Misses << std::setw(12) << s.writebacks
+            << std::setw(12) << s.stallCycles << std::endl;
+    }
+    out << "----------------------------------------" << std::endl;
+    out.flags(flags);
+    out.precision(precision);
+}
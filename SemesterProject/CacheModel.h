@@ -0,0 +1,86 @@
+#ifndef CACHE_MODEL_H
+#define CACHE_MODEL_H
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Set-associative cache hierarchy (L1 and optional L2) placed between the
+// interpreter and memory. It only keeps tags, so memory itself is never
+// copied; every access returns the stall cycles it costs. Only compiled in
+// with GTUSIM_CACHE_MODEL.
+enum Replacement { REPLACE_LRU, REPLACE_RANDOM };
+enum WritePolicy { WRITE_BACK, WRITE_THROUGH };
+
+struct CacheLevelConfig {
+    long sets;
+    int ways;
+    int lineWords;
+    long hitLatency;  // Stall cycles when this level hits
+};
+
+struct CacheConfig {
+    CacheLevelConfig l1;
+    CacheLevelConfig l2;     // l2.sets == 0: no L2
+    Replacement replacement;
+    WritePolicy writePolicy;
+    long memoryLatency;      // Stall cycles for a miss in the last level
+};
+
+// Parses "l1=<sets>x<ways>x<line>[,l2=<sets>x<ways>x<line>][,lru|random][,wb|wt]"
+bool parseCacheSpec(const std::string& spec, CacheConfig& config);
+
+class CacheLevel {
+public:
+    CacheLevel(const CacheLevelConfig& config, Replacement replacement, unsigned seed);
+
+    // Looks up the line holding address and allocates it on a miss. If a
+    // dirty line is evicted, its address is stored in evicted (else -1).
+    bool access(long address, bool write, bool markDirty, long& evicted);
+    const CacheLevelConfig& getConfig() const { return config; }
+
+private:
+    CacheLevelConfig config;
+    Replacement replacement;
+    std::vector<long> tags;            // sets * ways, -1 = invalid
+    std::vector<unsigned long> lastUse;
+    std::vector<char> dirty;
+    unsigned long clock;
+    std::mt19937 rng;
+};
+
+struct CacheStats {
+    long accesses;
+    long l1Misses;
+    long l2Misses;
+    long writebacks;     // Dirty lines written to the next level
+    long stallCycles;
+};
+
+class CacheHierarchy {
+public:
+    explicit CacheHierarchy(const CacheConfig& config);
+
+    // Stall cycles of one access by threadId; registers are not cached
+    long read(int threadId, long address) { return access(threadId, address, false); }
+    long write(int threadId, long address) { return access(threadId, address, true); }
+    long readRange(int threadId, long address, long count) { return accessRange(threadId, address, count, false); }
+    long writeRange(int threadId, long address, long count) { return accessRange(threadId, address, count, true); }
+
+    const std::vector<CacheStats>& getStats() const { return stats; }
+    void printReport(std::ostream& out) const;
+
+private:
+    CacheConfig config;
+    CacheLevel l1;
+    CacheLevel l2;
+    bool hasL2;
+    std::vector<CacheStats> stats;  // Indexed by thread id
+
+    long access(int threadId, long address, bool write);
+    long accessRange(int threadId, long address, long count, bool write);
+    long accessL2(CacheStats& threadStats, long address, bool write);
+};
+
+#endif // CACHE_MODEL_H
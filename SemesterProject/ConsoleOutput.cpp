@@ -0,0 +1,59 @@
+#include "ConsoleOutput.h"
+#include <iostream>
+
+ConsoleOutput::ConsoleOutput() : flushThreshold(DEFAULT_FLUSH_THRESHOLD) {
+}
+
+ConsoleOutput::~ConsoleOutput() {
+    flushAll();
+}
+
+void ConsoleOutput::setPerThreadFiles(const std::string& prefix) {
+    flushAll();
+    streams.clear();
+    filePrefix = prefix;
+}
+
+ConsoleOutput::Stream& ConsoleOutput::streamFor(int threadId) {
+    if (threadId < 0) threadId = 0;
+    if ((size_t)threadId >= streams.size()) {
+        streams.resize(threadId + 1);
+    }
+    return streams[threadId];
+}
+
+void ConsoleOutput::write(int threadId, long value) {
+    Stream& stream = streamFor(threadId);
+    stream.buffer += std::to_string(value);
+    stream.buffer += '\n';
+    if (stream.buffer.size() >= flushThreshold) {
+        flush(threadId);
+    }
+}
+
+void ConsoleOutput::flush(int threadId) {
+    Stream& stream = streamFor(threadId);
+    if (stream.buffer.empty()) return;
+
+    if (filePrefix.empty()) {
+        std::cout.write(stream.buffer.data(), stream.buffer.size());
+        std::cout.flush();
+    } else {
+        if (!stream.file) {
+            std::string name = filePrefix + "_thread" + std::to_string(threadId) + ".txt";
+            stream.file.reset(new std::ofstream(name, std::ios::out | std::ios::trunc));
+            if (!stream.file->is_open()) {
+                std::cerr << "Error: Could not open output file " << name << std::endl;
+            }
+        }
+        stream.file->write(stream.buffer.data(), stream.buffer.size());
+        stream.file->flush();
+    }
+    stream.buffer.clear();
+}
+
+void ConsoleOutput::flushAll() {
+    for (size_t i = 0; i < streams.size(); i++) {
+        flush((int)i);
+    }
+}
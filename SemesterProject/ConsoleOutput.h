@@ -0,0 +1,41 @@
+#ifndef CONSOLE_OUTPUT_H
+#define CONSOLE_OUTPUT_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+
+// Buffers the output of the PRN system call per simulated thread.
+// A thread's buffer is written out when the thread halts, when it grows
+// past the flush threshold, or when the simulator exits. Optionally each
+// thread's output goes to its own file instead of standard output.
+class ConsoleOutput {
+public:
+    static const size_t DEFAULT_FLUSH_THRESHOLD = 4096;
+
+    ConsoleOutput();
+    ~ConsoleOutput();
+
+    // Route thread N's output to "<prefix>_thread<N>.txt" (empty = stdout)
+    void setPerThreadFiles(const std::string& prefix);
+    void setFlushThreshold(size_t bytes) { flushThreshold = bytes; }
+
+    void write(int threadId, long value);
+    void flush(int threadId);
+    void flushAll();
+
+private:
+    struct Stream {
+        std::string buffer;
+        std::unique_ptr<std::ofstream> file;  // Only used in per-thread file mode
+    };
+
+    std::vector<Stream> streams;  // Indexed by thread id
+    std::string filePrefix;
+    size_t flushThreshold;
+
+    Stream& streamFor(int threadId);
+};
+
+#endif // CONSOLE_OUTPUT_H
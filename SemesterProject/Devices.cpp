@@ -0,0 +1,65 @@
+#include "Devices.h"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+bool BlockDevice::open(const std::string& path) {
+    // fstream only opens existing files for in|out, so create it first
+    if (!std::ifstream(path)) std::ofstream(path, std::ios::binary);
+    file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open disk image " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool BlockDevice::read(long offset, std::span<long> out) {
+    if (!file.is_open() || offset < 0 || offset > MAX_OFFSET - (long)out.size()) return false;
+    std::fill(out.begin(), out.end(), 0);
+    file.clear();
+    file.seekg(0, std::ios::end);
+    long words = (long)file.tellg() / BYTES_PER_WORD;
+    long available = std::min((long)out.size(), std::max(0L, words - offset));
+    file.seekg(offset * BYTES_PER_WORD);
+    for (long i = 0; i < available; i++) {
+        unsigned char bytes[BYTES_PER_WORD];
+        if (!file.read(reinterpret_cast<char*>(bytes), BYTES_PER_WORD)) return false;
+        uint64_t value = 0;
+        for (int b = BYTES_PER_WORD - 1; b >= 0; b--) value = value << 8 | bytes[b];
+        out[i] = (long)value;
+    }
+    return true;
+}
+
+bool BlockDevice::write(long offset, std::span<const long> in) {
+    if (!file.is_open() || offset < 0 || offset > MAX_OFFSET - (long)in.size()) return false;
+    file.clear();
+    // Seeking past the end leaves a hole that reads back as zeros
+    file.seekp(offset * BYTES_PER_WORD);
+    for (long value : in) {
+        unsigned char bytes[BYTES_PER_WORD];
+        for (int b = 0; b < BYTES_PER_WORD; b++) bytes[b] = (unsigned char)((uint64_t)value >> (8 * b));
+        file.write(reinterpret_cast<const char*>(bytes), BYTES_PER_WORD);
+    }
+    file.flush();
+    return (bool)file;
+}
+
+ConsoleDevice::ConsoleDevice() : input(&std::cin), requestLatency(DEFAULT_LATENCY) {}
+
+bool ConsoleDevice::open(const std::string& path) {
+    file = std::make_unique<std::ifstream>(path);
+    if (!file->is_open()) {
+        std::cerr << "Error: Could not open console input " << path << std::endl;
+        return false;
+    }
+    input = file.get();
+    return true;
+}
+
+long ConsoleDevice::read(std::span<long> out) {
+    long count = 0;
+    while (count < (long)out.size() && *input >> out[count]) count++;
+    return count;
+}
@@ -0,0 +1,61 @@
+#ifndef DEVICES_H
+#define DEVICES_H
+
+#include <climits>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <span>
+#include <string>
+
+// Host side of the simulated I/O devices (DISK_READ, DISK_WRITE and
+// CONSOLE_READ). The CPU queues requests per device and calls these when a
+// request completes; the latency is simulated time, counted in cycles.
+
+// Block device backed by a host file of 8-byte little-endian words
+class BlockDevice {
+public:
+    static const long DEFAULT_LATENCY = 100;  // Cycles per request
+    static const long CYCLES_PER_WORD = 1;    // Transfer time on top
+    static const long BYTES_PER_WORD = 8;
+    // Largest word offset whose byte position still fits in a long
+    static const long MAX_OFFSET = LONG_MAX / BYTES_PER_WORD;
+
+    BlockDevice() : requestLatency(DEFAULT_LATENCY) {}
+
+    // Opens path for reading and writing, creating it if needed
+    bool open(const std::string& path);
+    bool isOpen() const { return file.is_open(); }
+    void setLatency(long cycles) { requestLatency = cycles; }
+    long latency(long words) const { return requestLatency + words * CYCLES_PER_WORD; }
+
+    // Words past the end of the file read as 0; writes extend the file
+    bool read(long offset, std::span<long> out);
+    bool write(long offset, std::span<const long> in);
+
+private:
+    std::fstream file;
+    long requestLatency;
+};
+
+// Input console: whitespace-separated integers from standard input or a file
+class ConsoleDevice {
+public:
+    static const long DEFAULT_LATENCY = 50;
+
+    ConsoleDevice();
+
+    bool open(const std::string& path);
+    void setLatency(long cycles) { requestLatency = cycles; }
+    long latency() const { return requestLatency; }
+
+    // Reads up to out.size() numbers, returns how many were read (0 at end of input)
+    long read(std::span<long> out);
+
+private:
+    std::unique_ptr<std::ifstream> file;
+    std::istream* input;
+    long requestLatency;
+};
+
+#endif // DEVICES_H
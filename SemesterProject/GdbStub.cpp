@@ -0,0 +1,344 @@
+#include "GdbStub.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const char* const REGISTER_NAMES[GdbStub::REGISTER_COUNT] = {
+    "pc", "sp", "result", "instr_cnt", "block_len", "trap_vector", "trap_cause", "trap_pc", "trap_thread",
+    "r9", "r10", "r11", "r12", "r13", "r14",
+    "syscall_type", "syscall_param", "syscall_result", "blocked_thread", "timer", "os_state",
+};
+
+// Instructions between checks for a Ctrl-C from the debugger
+static const long INTERRUPT_CHECK_INTERVAL = 1024;
+
+static const int BYTES_PER_WORD = 8;
+
+static std::string targetDescription() {
+    std::string xml = "<?xml version=\"1.0\"?>\n<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+                      "<target version=\"1.0\">\n<feature name=\"org.gtu.c312.core\">\n";
+    for (int i = 0; i < GdbStub::REGISTER_COUNT; i++) {
+        const char* type = i == PC ? "code_ptr" : i == SP ? "data_ptr" : "int64";
+        xml += std::string("<reg name=\"") + REGISTER_NAMES[i] + "\" bitsize=\"64\" type=\"" + type + "\"/>\n";
+    }
+    return xml + "</feature>\n</target>\n";
+}
+
+static std::string hexByte(unsigned value) {
+    static const char digits[] = "0123456789abcdef";
+    return {digits[(value >> 4) & 0xF], digits[value & 0xF]};
+}
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parses a big-endian hex number (addresses, lengths, register numbers)
+static bool parseHex(const std::string& text, long& value) {
+    if (text.empty()) return false;
+    unsigned long result = 0;
+    for (char c : text) {
+        int digit = hexDigit(c);
+        if (digit < 0) return false;
+        result = result * 16 + digit;
+    }
+    value = (long)result;
+    return true;
+}
+
+// Register values are sent as little-endian bytes
+static std::string wordToHex(long value) {
+    std::string hex;
+    for (int i = 0; i < BYTES_PER_WORD; i++) hex += hexByte((unsigned)((unsigned long)value >> (8 * i)));
+    return hex;
+}
+
+static bool hexToWord(const std::string& hex, long& value) {
+    if (hex.size() != 2 * BYTES_PER_WORD) return false;
+    unsigned long result = 0;
+    for (int i = BYTES_PER_WORD - 1; i >= 0; i--) {
+        int high = hexDigit(hex[2 * i]), low = hexDigit(hex[2 * i + 1]);
+        if (high < 0 || low < 0) return false;
+        result = (result << 8) | (unsigned long)(high * 16 + low);
+    }
+    value = (long)result;
+    return true;
+}
+
+GdbStub::GdbStub(CPU& cpu) : cpu(cpu), listener(-1), client(-1), noAck(false), killed(false) {}
+
+GdbStub::~GdbStub() {
+    if (client >= 0) close(client);
+    if (listener >= 0) close(listener);
+}
+
+bool GdbStub::listen(int port) {
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        std::cerr << "Error: Could not create GDB socket" << std::endl;
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t)port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(listener, 1) != 0) {
+        std::cerr << "Error: Could not listen for GDB on port " << port << std::endl;
+        return false;
+    }
+    std::cerr << "Waiting for GDB on 127.0.0.1:" << port << std::endl;
+    return true;
+}
+
+bool GdbStub::serve() {
+    client = accept(listener, nullptr, nullptr);
+    if (client < 0) {
+        std::cerr << "Error: Could not accept GDB connection" << std::endl;
+        return false;
+    }
+    std::string packet;
+    bool done = false;
+    while (!done && readPacket(packet)) {
+        std::string reply = handle(packet, done);
+        // RSP expects no reply to 'k', the connection just closes
+        if (killed) break;
+        if (!sendPacket(reply)) break;
+        if (packet == "QStartNoAckMode") noAck = true;
+    }
+    close(client);
+    client = -1;
+    return true;
+}
+
+bool GdbStub::receive() {
+    char buffer[4096];
+    ssize_t n;
+    do {
+        n = recv(client, buffer, sizeof(buffer), 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return false;
+    input.append(buffer, (size_t)n);
+    return true;
+}
+
+// $<data>#<checksum>, or a lone 0x03 for an interrupt
+bool GdbStub::readPacket(std::string& packet) {
+    for (;;) {
+        while (!input.empty() && (input[0] == '+' || input[0] == '-')) input.erase(0, 1);
+        if (!input.empty() && input[0] == '\x03') {
+            input.erase(0, 1);
+            packet = "\x03";
+            return true;
+        }
+        size_t start = input.find('$');
+        size_t hash = start == std::string::npos ? std::string::npos : input.find('#', start);
+        if (hash != std::string::npos && hash + 2 < input.size()) {
+            packet = input.substr(start + 1, hash - start - 1);
+            long expected = 0;
+            parseHex(input.substr(hash + 1, 2), expected);
+            input.erase(0, hash + 3);
+            unsigned sum = 0;
+            for (char c : packet) sum += (unsigned char)c;
+            if ((long)(sum & 0xFF) == expected || noAck) {
+                if (!noAck && send(client, "+", 1, MSG_NOSIGNAL) != 1) return false;
+                return true;
+            }
+            if (send(client, "-", 1, MSG_NOSIGNAL) != 1) return false;
+            continue;
+        }
+        if (!receive()) return false;
+    }
+}
+
+bool GdbStub::sendPacket(const std::string& data) {
+    unsigned sum = 0;
+    for (char c : data) sum += (unsigned char)c;
+    std::string frame = "$" + data + "#" + hexByte(sum & 0xFF);
+    for (;;) {
+        if (send(client, frame.data(), frame.size(), MSG_NOSIGNAL) != (ssize_t)frame.size()) return false;
+        if (noAck) return true;
+        while (input.empty()) {
+            if (!receive()) return false;
+        }
+        if (input[0] == '-') {
+            input.erase(0, 1);
+            continue;
+        }
+        if (input[0] == '+') input.erase(0, 1);
+        return true;
+    }
+}
+
+bool GdbStub::interruptRequested() {
+    pollfd fd = {client, POLLIN, 0};
+    if (poll(&fd, 1, 0) > 0 && !receive()) return true;  // Disconnected: stop too
+    size_t at = input.find('\x03');
+    if (at == std::string::npos) return false;
+    input.erase(at, 1);
+    return true;
+}
+
+std::string GdbStub::resume(bool singleStep) {
+    for (long n = 1; !cpu.isHalted(); n++) {
+        cpu.step();
+        if (cpu.isHalted()) break;
+        long pc = cpu.getMemoryValue(PC);
+        if (singleStep || breakpoints.count(pc)) return "S05";  // SIGTRAP
+        if (n % INTERRUPT_CHECK_INTERVAL == 0 && interruptRequested()) return "S02";  // SIGINT
+    }
+    cpu.flushOutput();
+    return "W00";
+}
+
+std::string GdbStub::readRegister(int number) const {
+    long value = cpu.getMemoryValue(number);
+    if (number == PC || number == SP) value *= BYTES_PER_WORD;
+    return wordToHex(value);
+}
+
+void GdbStub::writeRegister(int number, long value) {
+    if (number == PC || number == SP) value /= BYTES_PER_WORD;
+    cpu.setMemoryValue(number, value);
+}
+
+std::string GdbStub::readMemory(long address, long length) const {
+    long size = (long)cpu.getMemorySize() * BYTES_PER_WORD;
+    // Both come from the packet, so compare without forming address + length
+    if (address < 0 || length < 0 || address > size || length > size - address) return "E01";
+    std::string hex;
+    for (long byte = address; byte < address + length; byte++) {
+        unsigned long word = (unsigned long)cpu.getMemoryValue((int)(byte / BYTES_PER_WORD));
+        hex += hexByte((unsigned)(word >> (8 * (byte % BYTES_PER_WORD))));
+    }
+    return hex;
+}
+
+bool GdbStub::writeMemory(long address, const std::string& hex) {
+    long length = (long)hex.size() / 2;
+    long size = (long)cpu.getMemorySize() * BYTES_PER_WORD;
+    if (address < 0 || address > size || length > size - address || hex.size() % 2 != 0) return false;
+    for (long i = 0; i < length; i++) {
+        int high = hexDigit(hex[2 * i]), low = hexDigit(hex[2 * i + 1]);
+        if (high < 0 || low < 0) return false;
+        int word = (int)((address + i) / BYTES_PER_WORD);
+        int shift = 8 * (int)((address + i) % BYTES_PER_WORD);
+        unsigned long value = (unsigned long)cpu.getMemoryValue(word);
+        value = (value & ~(0xFFUL << shift)) | ((unsigned long)(high * 16 + low) << shift);
+        cpu.setMemoryValue(word, (long)value);
+    }
+    return true;
+}
+
+std::string GdbStub::handle(const std::string& packet, bool& done) {
+    if (packet.empty()) return "";
+    std::string args = packet.substr(1);
+    switch (packet[0]) {
+        case '\x03': return "S02";
+        case '?': return cpu.isHalted() ? "W00" : "S05";
+        case 'g': {
+            std::string hex;
+            for (int i = 0; i < REGISTER_COUNT; i++) hex += readRegister(i);
+            return hex;
+        }
+        case 'G': {
+            if (args.size() < (size_t)REGISTER_COUNT * 2 * BYTES_PER_WORD) return "E01";
+            for (int i = 0; i < REGISTER_COUNT; i++) {
+                long value;
+                if (!hexToWord(args.substr(i * 2 * BYTES_PER_WORD, 2 * BYTES_PER_WORD), value)) return "E01";
+                writeRegister(i, value);
+            }
+            return "OK";
+        }
+        case 'p': {
+            long number;
+            if (!parseHex(args, number) || number < 0 || number >= REGISTER_COUNT) return "E01";
+            return readRegister((int)number);
+        }
+        case 'P': {
+            size_t eq = args.find('=');
+            long number, value;
+            if (eq == std::string::npos || !parseHex(args.substr(0, eq), number) || number < 0 ||
+                number >= REGISTER_COUNT || !hexToWord(args.substr(eq + 1), value)) {
+                return "E01";
+            }
+            writeRegister((int)number, value);
+            return "OK";
+        }
+        case 'm': {
+            size_t comma = args.find(',');
+            long address, length;
+            if (comma == std::string::npos || !parseHex(args.substr(0, comma), address) ||
+                !parseHex(args.substr(comma + 1), length)) {
+                return "E01";
+            }
+            return readMemory(address, length);
+        }
+        case 'M': {
+            size_t comma = args.find(','), colon = args.find(':');
+            long address, length;
+            if (comma == std::string::npos || colon == std::string::npos ||
+                !parseHex(args.substr(0, comma), address) ||
+                !parseHex(args.substr(comma + 1, colon - comma - 1), length) ||
+                length < 0 || (long)(args.size() - colon - 1) / 2 != length) {
+                return "E01";
+            }
+            return writeMemory(address, args.substr(colon + 1)) ? "OK" : "E01";
+        }
+        case 'Z': case 'z': {
+            // Z<type>,<address>,<kind>: software (0) and hardware (1) breakpoints
+            if (args.size() < 3 || (args[0] != '0' && args[0] != '1') || args[1] != ',') return "";
+            size_t comma = args.find(',', 2);
+            long address;
+            if (!parseHex(args.substr(2, comma == std::string::npos ? std::string::npos : comma - 2), address)) {
+                return "E01";
+            }
+            if (packet[0] == 'Z') breakpoints.insert(address / BYTES_PER_WORD);
+            else breakpoints.erase(address / BYTES_PER_WORD);
+            return "OK";
+        }
+        case 'c': case 's': {
+            long address;
+            if (!args.empty() && parseHex(args, address)) cpu.setMemoryValue(PC, address / BYTES_PER_WORD);
+            return resume(packet[0] == 's');
+        }
+        case 'D': case 'k':
+            killed = packet[0] == 'k';
+            done = true;
+            return killed ? "" : "OK";
+        case 'H': case 'T':
+            return "OK";
+        case 'q':
+            if (packet.rfind("qSupported", 0) == 0) return "PacketSize=4000;qXfer:features:read+;QStartNoAckMode+";
+            if (packet == "qAttached") return "1";
+            if (packet == "qC") return "QC1";
+            if (packet == "qfThreadInfo") return "m1";
+            if (packet == "qsThreadInfo") return "l";
+            if (packet.rfind("qXfer:features:read:target.xml:", 0) == 0) {
+                std::string range = packet.substr(sizeof("qXfer:features:read:target.xml:") - 1);
+                size_t comma = range.find(',');
+                long offset, length;
+                if (comma == std::string::npos || !parseHex(range.substr(0, comma), offset) ||
+                    !parseHex(range.substr(comma + 1), length)) {
+                    return "E01";
+                }
+                std::string xml = targetDescription();
+                if (offset >= (long)xml.size()) return "l";
+                std::string chunk = xml.substr(offset, length);
+                return (offset + (long)chunk.size() < (long)xml.size() ? "m" : "l") + chunk;
+            }
+            return "";
+        case 'Q':
+            if (packet == "QStartNoAckMode") return "OK";
+            return "";
+        default:
+            return "";
+    }
+}
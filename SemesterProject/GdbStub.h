@@ -0,0 +1,57 @@
+#ifndef GDB_STUB_H
+#define GDB_STUB_H
+
+#include "CPU.h"
+#include <set>
+#include <string>
+
+// GDB remote serial protocol server for one debugger on a local TCP port
+// (simulate --gdb-port). GDB sees memory in bytes: word w is the 8 bytes
+// at w * 8, little-endian, and the pc and sp registers hold byte
+// addresses too. The registers are the memory-mapped words 0-20, described
+// to GDB in target.xml.
+//
+// Supported: register read/write (g, G, p, P), memory read/write (m, M),
+// breakpoints (Z0/Z1, z0/z1), single-step (s), continue (c) with Ctrl-C
+// interrupts, detach (D) and kill (k). While waiting for a packet the
+// stub blocks in recv, so a stopped CPU costs no host time.
+class GdbStub {
+public:
+    static const int REGISTER_COUNT = OS_STATE + 1;
+
+    explicit GdbStub(CPU& cpu);
+    ~GdbStub();
+    GdbStub(const GdbStub&) = delete;
+    GdbStub& operator=(const GdbStub&) = delete;
+
+    // Listens on 127.0.0.1:port
+    bool listen(int port);
+    // Waits for a debugger and serves it until it detaches, kills the
+    // session or disconnects
+    bool serve();
+    // The debugger ended the session with k; after a detach the caller
+    // runs the program on
+    bool wasKilled() const { return killed; }
+
+private:
+    CPU& cpu;
+    int listener;
+    int client;
+    bool noAck;
+    bool killed;
+    std::string input;          // Received but not yet parsed
+    std::set<long> breakpoints;  // Word addresses
+
+    bool receive();
+    bool readPacket(std::string& packet);
+    bool sendPacket(const std::string& data);
+    bool interruptRequested();
+    std::string handle(const std::string& packet, bool& done);
+    std::string resume(bool singleStep);
+    std::string readRegister(int number) const;
+    void writeRegister(int number, long value);
+    std::string readMemory(long address, long length) const;
+    bool writeMemory(long address, const std::string& hex);
+};
+
+#endif // GDB_STUB_H
@@ -0,0 +1,108 @@
+#include "HostServices.h"
+#include "CPU.h"
+#include <algorithm>
+#include <cstring>
+
+// Maps an argument block of n words, checked against the current mode
+static bool mapArgs(CPU& cpu, long param, long n, std::span<long>& block) {
+    if (!cpu.mapRange(param, n, block)) {
+        std::cerr << "Error: Invalid syscall argument block at " << param << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Copies the arguments out, so a service may overwrite its own block
+static bool readArgs(CPU& cpu, long param, long* args, long n) {
+    std::span<long> block;
+    if (!mapArgs(cpu, param, n, block)) return false;
+    std::copy(block.begin(), block.end(), args);
+    return true;
+}
+
+static void setResult(CPU& cpu, long value) {
+    cpu.setMemoryValue(RESULT, value);
+}
+
+// Services that return data also store it in the last word of their block,
+// since user threads cannot read RESULT
+static void setResult(CPU& cpu, std::span<long> block, long value) {
+    block.back() = value;
+    setResult(cpu, value);
+}
+
+static void sysMemmove(CPU& cpu, long param) {
+    long args[3];
+    std::span<long> src, dst;
+    if (!readArgs(cpu, param, args, 3) ||
+        !cpu.mapRange(args[0], args[2], src) || !cpu.mapRange(args[1], args[2], dst)) {
+        setResult(cpu, -1);
+        return;
+    }
+    if (!src.empty()) std::memmove(dst.data(), src.data(), src.size_bytes());
+    setResult(cpu, 0);
+}
+
+static void sysMemcmp(CPU& cpu, long param) {
+    std::span<long> block, a, b;
+    if (!mapArgs(cpu, param, 4, block)) {
+        setResult(cpu, -1);
+        return;
+    }
+    if (!cpu.mapRange(block[0], block[2], a) || !cpu.mapRange(block[1], block[2], b)) {
+        setResult(cpu, block, -1);
+        return;
+    }
+    auto diff = std::mismatch(a.begin(), a.end(), b.begin());
+    setResult(cpu, block, diff.first == a.end() ? 0 : (*diff.first < *diff.second ? -1 : 1));
+}
+
+static void sysMemset(CPU& cpu, long param) {
+    long args[3];
+    std::span<long> dst;
+    if (!readArgs(cpu, param, args, 3) || !cpu.mapRange(args[0], args[2], dst)) {
+        setResult(cpu, -1);
+        return;
+    }
+    std::fill(dst.begin(), dst.end(), args[1]);
+    setResult(cpu, 0);
+}
+
+static void sysSort(CPU& cpu, long param) {
+    long args[2];
+    std::span<long> data;
+    if (!readArgs(cpu, param, args, 2) || !cpu.mapRange(args[0], args[1], data)) {
+        setResult(cpu, -1);
+        return;
+    }
+    std::sort(data.begin(), data.end());
+    setResult(cpu, 0);
+}
+
+static void sysHash(CPU& cpu, long param) {
+    std::span<long> block, data;
+    if (!mapArgs(cpu, param, 3, block)) {
+        setResult(cpu, -1);
+        return;
+    }
+    if (!cpu.mapRange(block[0], block[1], data)) {
+        setResult(cpu, block, -1);
+        return;
+    }
+    unsigned long long hash = 1469598103934665603ULL;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data.data());
+    for (size_t i = 0; i < data.size_bytes(); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    // Keep the result non-negative so it cannot be mistaken for an error
+    setResult(cpu, block, (long)(hash >> 1));
+}
+
+void registerHostServices(CPU& cpu) {
+    cpu.registerSyscall(SYS_MEMMOVE, sysMemmove);
+    cpu.registerSyscall(SYS_MEMCMP, sysMemcmp);
+    cpu.registerSyscall(SYS_MEMSET, sysMemset);
+    cpu.registerSyscall(SYS_SORT, sysSort);
+    cpu.registerSyscall(SYS_HASH, sysHash);
+}
@@ -0,0 +1,20 @@
+#ifndef HOST_SERVICES_H
+#define HOST_SERVICES_H
+
+class CPU;
+
+// Native services exposed to GTU-C312 programs as system calls.
+// The syscall parameter is the address of an argument block; the result
+// is written to the RESULT register (memory[2]), -1 on invalid arguments.
+// MEMCMP and HASH also write it to the last word of the block.
+enum HostService {
+    SYS_MEMMOVE = 10,  // [src, dst, count]          copy count words, ranges may overlap
+    SYS_MEMCMP = 11,   // [a, b, count, result]      result = -1, 0 or 1 like memcmp
+    SYS_MEMSET = 12,   // [dst, value, count]        fill count words with value
+    SYS_SORT = 13,     // [address, count]           sort count words in increasing order
+    SYS_HASH = 14      // [address, count, result]   result = FNV-1a hash of the words
+};
+
+void registerHostServices(CPU& cpu);
+
+#endif // HOST_SERVICES_H
@@ -0,0 +1,148 @@
+#include "InputLog.h"
+#include <algorithm>
+#include <iostream>
+
+static const char MAGIC[4] = {'G', 'T', 'U', 'L'};
+
+bool InputLog::create(const std::string& path) {
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Error: Could not create input log " << path << std::endl;
+        return false;
+    }
+    out.write(MAGIC, sizeof(MAGIC));
+    out.put((char)VERSION);
+    replay = false;
+    return true;
+}
+
+bool InputLog::open(const std::string& path) {
+    in.open(path, std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "Error: Could not open input log " << path << std::endl;
+        return false;
+    }
+    char magic[sizeof(MAGIC)];
+    if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), MAGIC) ||
+        in.get() != VERSION) {
+        std::cerr << "Error: " << path << " is not an input log of this version" << std::endl;
+        return false;
+    }
+    replay = true;
+    return true;
+}
+
+void InputLog::writeUnsigned(uint64_t value) {
+    while (value >= 0x80) {
+        out.put((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.put((char)value);
+}
+
+bool InputLog::readUnsigned(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = in.get();
+        if (byte == EOF) return false;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool InputLog::readSigned(long& value) {
+    uint64_t raw;
+    if (!readUnsigned(raw)) return false;
+    value = (long)(raw >> 1) ^ -(long)(raw & 1);
+    return true;
+}
+
+// Moves to the next record with tag, skipping keys; a replay that finds
+// anything else has diverged from the recording
+bool InputLog::nextRecord(char tag) {
+    while (!failed) {
+        int next = in.peek();
+        if (next == tag) {
+            in.get();
+            return true;
+        }
+        if (next == 'K') {
+            uint64_t skipped;
+            in.get();
+            if (readUnsigned(skipped)) continue;
+        }
+        std::cerr << "Error: Replay diverged from the input log (expected record '" << tag << "')" << std::endl;
+        failed = true;
+    }
+    return false;
+}
+
+void InputLog::recordKey(int key) {
+    out.put('K');
+    writeUnsigned((uint64_t)(unsigned char)key);
+}
+
+void InputLog::recordResult(long value) {
+    out.put('R');
+    writeSigned(value);
+}
+
+void InputLog::recordIo(bool ok, std::span<const long> values) {
+    out.put('I');
+    writeUnsigned(ok ? 1 : 0);
+    writeUnsigned(values.size());
+    for (long value : values) writeSigned(value);
+}
+
+void InputLog::recordEnd(uint64_t hash, long instructions) {
+    out.put('E');
+    writeUnsigned(hash);
+    writeSigned(instructions);
+    out.flush();
+}
+
+bool InputLog::replayKey(int& key) {
+    if (failed || in.peek() != 'K') return false;
+    in.get();
+    uint64_t value;
+    if (!readUnsigned(value)) return false;
+    key = (int)value;
+    return true;
+}
+
+bool InputLog::replayResult(long& value) {
+    if (nextRecord('R') && readSigned(value)) return true;
+    failed = true;
+    return false;
+}
+
+bool InputLog::replayIo(bool& ok, std::span<long> data, long& count) {
+    uint64_t status, size;
+    count = 0;
+    if (!nextRecord('I') || !readUnsigned(status) || !readUnsigned(size)) {
+        failed = true;
+        return false;
+    }
+    if (size > data.size()) {
+        std::cerr << "Error: Input log I/O record has " << size << " words for a request of " << data.size()
+                  << std::endl;
+        failed = true;
+        return false;
+    }
+    ok = status != 0;
+    for (uint64_t i = 0; i < size; i++) {
+        if (!readSigned(data[i])) {
+            failed = true;
+            return false;
+        }
+    }
+    count = (long)size;
+    return true;
+}
+
+bool InputLog::replayEnd(uint64_t& hash, long& instructions) {
+    if (nextRecord('E') && readUnsigned(hash) && readSigned(instructions)) return true;
+    failed = true;
+    return false;
+}
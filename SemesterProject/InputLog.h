@@ -0,0 +1,58 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <string>
+#include <vector>
+
+// Values that enter a simulation from the host, in the order the CPU
+// consumed them (simulate --record / --replay): input console and disk
+// data, results of host system calls and keypresses in debug mode 2. The
+// log ends with the final memory hash and instruction count, so a replay
+// can check that it reproduced the run bit for bit.
+//
+// File format: "GTUL", a version byte, then records of a tag byte followed
+// by LEB128 varints (signed values zigzag-encoded):
+//   K key | R result | I ok count value... | E hash instructions
+class InputLog {
+public:
+    static const uint8_t VERSION = 1;
+
+    InputLog() : replay(false), failed(false) {}
+
+    bool create(const std::string& path);  // Record into path
+    bool open(const std::string& path);    // Replay from path
+    bool isReplay() const { return replay; }
+    // A replay ran past the end of the log or found the wrong record
+    bool hasFailed() const { return failed; }
+
+    void recordKey(int key);
+    void recordResult(long value);
+    void recordIo(bool ok, std::span<const long> values);
+    void recordEnd(uint64_t hash, long instructions);
+
+    // Keys are only consumed when the replay itself waits for one; the
+    // other readers skip them, so a replay may run without debug mode
+    bool replayKey(int& key);
+    bool replayResult(long& value);
+    // Reads one I/O record into data, count gets the values it held. A
+    // record longer than data means the log belongs to another run.
+    bool replayIo(bool& ok, std::span<long> data, long& count);
+    bool replayEnd(uint64_t& hash, long& instructions);
+
+private:
+    std::ofstream out;
+    std::ifstream in;
+    bool replay;
+    bool failed;
+
+    void writeUnsigned(uint64_t value);
+    void writeSigned(long value) { writeUnsigned(((uint64_t)value << 1) ^ (uint64_t)(value >> 63)); }
+    bool readUnsigned(uint64_t& value);
+    bool readSigned(long& value);
+    bool nextRecord(char tag);
+};
+
+#endif // INPUT_LOG_H
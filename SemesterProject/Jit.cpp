@@ -0,0 +1,323 @@
+#include "Jit.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define GTUSIM_JIT_X86_64 1
+#endif
+
+// Passed to compiled code in rsi
+struct NativeState {
+    long executed;  // Instructions retired, written on exit
+    long budget;    // Loops stop before executed would exceed this
+};
+
+using NativeFunction = long (*)(long* memory, NativeState* state);
+
+// Constant address an instruction stores to, -1 if it stores nothing
+static long storeTarget(const Instruction& inst) {
+    switch (inst.opcode) {
+        case 1: case 2: case 3: case 6: return inst.param2;
+        case 4: case 5: return inst.param1;
+        default: return -1;
+    }
+}
+
+static bool readsOrWrites(const Instruction& inst, long address) {
+    switch (inst.opcode) {
+        case 1: return inst.param2 == address;
+        case 4: case 7: return inst.param1 == address;
+        default: return inst.param1 == address || inst.param2 == address;
+    }
+}
+
+// x86-64 machine code for one block. Register use:
+//   rbx  memory base    r12  instructions retired    r13  budget
+//   r14  NativeState*   rax  scratch and return PC
+class Emitter {
+public:
+    std::vector<uint8_t> code;
+
+    void bytes(std::initializer_list<uint8_t> list) { code.insert(code.end(), list); }
+    void imm64(long value) {
+        uint8_t raw[8];
+        std::memcpy(raw, &value, 8);
+        code.insert(code.end(), raw, raw + 8);
+    }
+    void imm32(long value) {
+        int32_t v = (int32_t)value;
+        uint8_t raw[4];
+        std::memcpy(raw, &v, 4);
+        code.insert(code.end(), raw, raw + 4);
+    }
+    // <rex> <op> [rbx + address * 8] with a 32-bit displacement
+    void memory(uint8_t rex, uint8_t op, int reg, long address) {
+        bytes({rex, op, (uint8_t)(0x83 | (reg << 3))});
+        imm32(address * 8);
+    }
+    void loadRax(long address) { memory(0x48, 0x8B, 0, address); }   // mov rax, [m]
+    void storeRax(long address) { memory(0x48, 0x89, 0, address); }  // mov [m], rax
+    void addRaxTo(long address) { memory(0x48, 0x01, 0, address); }  // add [m], rax
+    void subFromRax(long address) { memory(0x48, 0x2B, 0, address); }  // sub rax, [m]
+    void setImmediate(long address, long value) { memory(0x48, 0xC7, 0, address); imm32(value); }
+    void addImmediate(long address, long value) { memory(0x48, 0x81, 0, address); imm32(value); }
+    void compareZero(long address) { memory(0x48, 0x83, 7, address); bytes({0}); }
+
+    // Jumps with a rel32 to patch, returns the offset of the rel32
+    size_t jump() { bytes({0xE9}); imm32(0); return code.size() - 4; }
+    size_t jumpIf(uint8_t condition) { bytes({0x0F, condition}); imm32(0); return code.size() - 4; }
+    void patch(size_t at, size_t target) {
+        int32_t rel = (int32_t)(target - (at + 4));
+        std::memcpy(&code[at], &rel, 4);
+    }
+};
+
+static const uint8_t JBE = 0x86, JL = 0x8C, JGE = 0x8D, JG = 0x8F;
+
+// Leaves the block: owed instruction counts go to INSTR_CNT, executed to
+// r12, the next PC to rax
+struct BlockExit {
+    std::vector<size_t> jumps;
+    long executed;
+    long pc;
+    long owed;
+};
+
+Jit::Jit(long threshold)
+    : threshold(std::max(1L, threshold)), buffer(nullptr), used(0), compiledBlocks(0), nativeInstructions(0) {
+#ifdef GTUSIM_JIT_X86_64
+    void* mapped = mmap(nullptr, CODE_BUFFER_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped != MAP_FAILED) buffer = (uint8_t*)mapped;
+#endif
+}
+
+Jit::~Jit() {
+#ifdef GTUSIM_JIT_X86_64
+    if (buffer) munmap(buffer, CODE_BUFFER_BYTES);
+#endif
+}
+
+bool Jit::isSupported() {
+#ifdef GTUSIM_JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Jit::resetCache(size_t memorySize) {
+    blocks.clear();
+    used = 0;
+    for (int mode = 0; mode < 2; mode++) {
+        blockAt[mode].assign(memorySize, -1);
+        counts[mode].assign(memorySize, 0);
+    }
+}
+
+int Jit::compile(CPU& cpu, long start, bool kernelMode) {
+    const long* memory = cpu.nativeMemory();
+    long size = (long)cpu.getMemorySize();
+    auto valid = [&](long address) { return address > PC && address < size && (kernelMode || address >= 1000); };
+
+    // Longest run of instructions whose constant operands are valid in this
+    // mode, within the thread region. JIFs are side exits, except one back
+    // to the start, which closes the block.
+    std::vector<Instruction> code;
+    for (long address = start; address < size && (long)code.size() < MAX_BLOCK_LENGTH; address++) {
+        if (address != start && address % 1000 == 0) break;
+        Instruction inst = decodeInstruction(memory[address]);
+        bool ok = false;
+        switch (inst.opcode) {
+            case 1: ok = valid(inst.param2); break;
+            case 2: case 3: case 5: case 6: ok = valid(inst.param1) && valid(inst.param2); break;
+            case 4: case 7: ok = valid(inst.param1); break;
+        }
+        if (!ok) break;
+        code.push_back(inst);
+        if (inst.opcode == 7 && inst.param2 == start) break;
+    }
+    // A store into the block's own later words ends it, so they are fetched again
+    long length = (long)code.size();
+    for (long i = 0; i < length; i++) {
+        long target = storeTarget(code[i]);
+        if (target > start + i && target < start + length) {
+            length = i + 1;
+            break;
+        }
+    }
+    code.resize(length);
+    if (length == 0) return -1;
+    bool storesIntoBlock = false;
+    for (const Instruction& inst : code) {
+        long target = storeTarget(inst);
+        if (target >= start && target < start + length) storesIntoBlock = true;
+    }
+
+    const Instruction& last = code.back();
+    long end = start + length;
+    // Jumping back to its own start, a block that leaves its words alone can loop
+    bool loops = last.opcode == 7 && last.param2 == start && start >= THREAD_CODE_OFFSET && !storesIntoBlock;
+
+    Emitter e;
+    std::vector<BlockExit> exits;
+    auto exitTo = [&](long executed, long pc, long owed) {
+        exits.push_back({{}, executed, pc, owed});
+        return &exits.back().jumps;
+    };
+    auto emitExit = [&](const BlockExit& exit, std::vector<size_t>& toEpilogue) {
+        if (exit.owed != 0) e.addImmediate(INSTR_CNT, exit.owed);
+        if (exit.executed != 0) { e.bytes({0x49, 0x81, 0xC4}); e.imm32(exit.executed); }  // add r12, n
+        e.bytes({0x48, 0xC7, 0xC0}); e.imm32(exit.pc);                                   // mov rax, pc
+        toEpilogue.push_back(e.jump());
+    };
+    exits.reserve(length + 2);  // exitTo hands out pointers into exits
+
+    // Prologue: push rbx, r12, r13, r14; rbx = memory; r14 = state; r12 = 0; r13 = budget
+    e.bytes({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56});
+    e.bytes({0x48, 0x89, 0xFB, 0x49, 0x89, 0xF6, 0x45, 0x31, 0xE4, 0x4C, 0x8B, 0x6E, 0x08});
+    size_t top = e.code.size();
+
+    long owed = 0;  // INSTR_CNT increments not yet written back this iteration
+    for (long i = 0; i < length; i++) {
+        const Instruction& inst = code[i];
+        long p1 = inst.param1, p2 = inst.param2;
+        owed++;
+        if (inst.opcode == 3 || readsOrWrites(inst, INSTR_CNT)) {
+            e.addImmediate(INSTR_CNT, owed);
+            owed = 0;
+        }
+        switch (inst.opcode) {
+            case 1: e.setImmediate(p2, p1); break;
+            case 2: e.loadRax(p1); e.storeRax(p2); break;
+            case 3: {
+                // The interpreter counts the instruction before it faults, so undo ours
+                e.loadRax(p1);
+                e.bytes({0x48, 0x3D}); e.imm32(kernelMode ? PC + 1 : 1000);  // cmp rax, lowest
+                size_t below = e.jumpIf(JL);
+                e.bytes({0x48, 0x3D}); e.imm32(size);                        // cmp rax, size
+                size_t above = e.jumpIf(JGE);
+                std::vector<size_t>* out = exitTo(i, start + i, -1);
+                out->push_back(below);
+                out->push_back(above);
+                e.bytes({0x48, 0x8B, 0x04, 0xC3});                           // mov rax, [rbx + rax * 8]
+                e.storeRax(p2);
+                break;
+            }
+            case 4: e.addImmediate(p1, p2); break;
+            case 5: e.loadRax(p2); e.addRaxTo(p1); break;
+            case 6: e.loadRax(p1); e.subFromRax(p2); e.storeRax(p2); break;
+            case 7: {
+                // The interpreter never jumps below the code area or out of memory
+                if (p2 < THREAD_CODE_OFFSET || p2 >= size) break;
+                e.compareZero(p1);
+                if (loops && i == length - 1) {
+                    exitTo(length, end, owed)->push_back(e.jumpIf(JG));
+                    if (owed != 0) e.addImmediate(INSTR_CNT, owed);
+                    e.bytes({0x49, 0x81, 0xC4}); e.imm32(length);  // add r12, length
+                    e.bytes({0x4C, 0x89, 0xE0});                   // mov rax, r12
+                    e.bytes({0x48, 0x05}); e.imm32(length);        // add rax, length
+                    e.bytes({0x4C, 0x39, 0xE8});                   // cmp rax, r13
+                    exitTo(0, start, 0)->push_back(e.jumpIf(JG));
+                    size_t back = e.jump();
+                    e.patch(back, top);
+                    break;
+                }
+                size_t notTaken = e.jumpIf(JG);
+                // The target must hold an instruction: |word| >= 10^12
+                e.loadRax(p2);
+                e.bytes({0x48, 0xB9}); e.imm64(999999999999L);    // mov rcx, 10^12 - 1
+                e.bytes({0x48, 0x01, 0xC8});                      // add rax, rcx
+                e.bytes({0x48, 0xB9}); e.imm64(1999999999998L);   // mov rcx, 2 * (10^12 - 1)
+                e.bytes({0x48, 0x39, 0xC8});                      // cmp rax, rcx
+                size_t noInstruction = e.jumpIf(JBE);
+                exitTo(i + 1, p2, owed)->push_back(e.jump());
+                e.patch(notTaken, e.code.size());
+                e.patch(noInstruction, e.code.size());
+                break;
+            }
+        }
+    }
+
+    std::vector<size_t> toEpilogue;
+    if (!loops) {
+        BlockExit fallThrough = {{}, length, end, owed};
+        emitExit(fallThrough, toEpilogue);
+    }
+    for (const BlockExit& exit : exits) {
+        for (size_t at : exit.jumps) e.patch(at, e.code.size());
+        emitExit(exit, toEpilogue);
+    }
+    // Epilogue: state->executed = r12; pop r14, r13, r12, rbx; ret
+    for (size_t at : toEpilogue) e.patch(at, e.code.size());
+    e.bytes({0x4D, 0x89, 0x26, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});
+
+    if (used + e.code.size() > CODE_BUFFER_BYTES) {
+        resetCache(size);
+        if (e.code.size() > CODE_BUFFER_BYTES) return -1;
+    }
+#ifdef GTUSIM_JIT_X86_64
+    if (mprotect(buffer, CODE_BUFFER_BYTES, PROT_READ | PROT_WRITE) != 0) return -1;
+    std::memcpy(buffer + used, e.code.data(), e.code.size());
+    if (mprotect(buffer, CODE_BUFFER_BYTES, PROT_READ | PROT_EXEC) != 0) return -1;
+#endif
+
+    CompiledBlock block;
+    block.start = start;
+    block.length = length;
+    block.words.assign(memory + start, memory + end);
+    block.cycles.assign(1, 0);
+    for (const Instruction& inst : code) block.cycles.push_back(block.cycles.back() + cpu.getCycleCost(inst.opcode));
+    block.code = buffer + used;
+    used += (e.code.size() + 15) & ~(size_t)15;
+    blocks.push_back(std::move(block));
+    blockAt[kernelMode ? 1 : 0][start] = (int)blocks.size() - 1;
+    compiledBlocks++;
+    return (int)blocks.size() - 1;
+}
+
+bool Jit::runBlock(CPU& cpu, const CompiledBlock& block, long budget, long& executed) {
+    long* memory = cpu.nativeMemory();
+    if (block.length > budget) return false;
+    if (!std::equal(block.words.begin(), block.words.end(), memory + block.start)) {
+        blockAt[cpu.isInKernelMode() ? 1 : 0][block.start] = -1;
+        return false;
+    }
+    NativeState state = {0, budget};
+    long next = reinterpret_cast<NativeFunction>(const_cast<uint8_t*>(block.code))(memory, &state);
+    executed = state.executed;
+    if (executed == 0) return false;
+    memory[PC] = next;
+    cpu.retireNative(block.start, executed,
+                     executed / block.length * block.cycles[block.length] + block.cycles[executed % block.length]);
+    nativeInstructions += executed;
+    return true;
+}
+
+long Jit::run(CPU& cpu, long maxSteps) {
+    size_t size = cpu.getMemorySize();
+    if (!buffer || size > (size_t)INT32_MAX / 8) return cpu.run(maxSteps);
+    if (blockAt[0].size() != size) resetCache(size);
+
+    long* memory = cpu.nativeMemory();
+    long steps = 0;
+    while (!cpu.isHalted() && (maxSteps < 0 || steps < maxSteps)) {
+        long pc = memory[PC];
+        if (pc >= 0 && pc < (long)size && cpu.canRunNative()) {
+            int mode = cpu.isInKernelMode() ? 1 : 0;
+            int index = blockAt[mode][pc];
+            if (index < 0 && ++counts[mode][pc] >= (uint32_t)threshold) {
+                counts[mode][pc] = 0;
+                index = compile(cpu, pc, mode == 1);
+            }
+            long executed = 0;
+            if (index >= 0 && runBlock(cpu, blocks[index], maxSteps < 0 ? LONG_MAX : maxSteps - steps, executed)) {
+                steps += executed;
+                continue;
+            }
+        }
+        cpu.step();
+        steps++;
+    }
+    return steps;
+}
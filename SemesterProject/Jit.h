@@ -0,0 +1,61 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "CPU.h"
+#include <cstdint>
+#include <vector>
+
+// Baseline JIT for x86-64 Linux. Each time the interpreter is about to run
+// an instruction the JIT counts its address; past the threshold it compiles
+// the straight-line block starting there (SET, CPY, CPYI, ADD, ADDI, SUBI
+// and JIF as a side exit) into an mmap'ed code buffer. A block that jumps
+// back to its own start loops natively until the step budget runs out.
+//
+// Bounds and user-mode checks on constant addresses are resolved while
+// compiling (blocks are compiled per mode); CPYI checks its indirect
+// address at run time. Anything a block cannot do (faults, PC accesses,
+// syscalls, stack and mode switches) goes back to the interpreter. Blocks
+// check their source words on entry, so self-modified code is recompiled.
+// On other hosts run() just interprets.
+class Jit {
+public:
+    static const long DEFAULT_THRESHOLD = 50;
+    static const long MAX_BLOCK_LENGTH = 64;
+    static const size_t CODE_BUFFER_BYTES = 4 << 20;
+
+    explicit Jit(long threshold = DEFAULT_THRESHOLD);
+    ~Jit();
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    static bool isSupported();
+    // Runs cpu like CPU::run, returns steps executed
+    long run(CPU& cpu, long maxSteps = -1);
+
+    long getCompiledBlocks() const { return compiledBlocks; }
+    long getNativeInstructions() const { return nativeInstructions; }
+
+private:
+    struct CompiledBlock {
+        long start;
+        long length;
+        std::vector<long> words;   // Source words, compared on entry
+        std::vector<long> cycles;  // cycles[i]: cost of the first i instructions
+        const uint8_t* code;
+    };
+
+    long threshold;
+    uint8_t* buffer;
+    size_t used;
+    std::vector<CompiledBlock> blocks;
+    std::vector<int> blockAt[2];      // Index into blocks by [kernel mode][address], -1 = none
+    std::vector<uint32_t> counts[2];  // Interpreted executions by [kernel mode][address]
+    long compiledBlocks;
+    long nativeInstructions;
+
+    void resetCache(size_t memorySize);
+    int compile(CPU& cpu, long start, bool kernelMode);
+    bool runBlock(CPU& cpu, const CompiledBlock& block, long budget, long& executed);
+};
+
+#endif // JIT_H
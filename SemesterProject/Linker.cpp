@@ -0,0 +1,160 @@
+#include "CPU.h"
+#include "Assembler.h"
+#include <fstream>
+#include <sstream>
+
+// Thread images are written as if they were thread 1: data at 1000-1999,
+// instructions numbered from 0 and jump targets given as instruction
+// numbers. Linking places thread i at base = i * 1000 and rewrites the
+// operands to match.
+enum OperandKind {
+    OPERAND_NONE,     // Immediate or unused
+    OPERAND_ADDRESS,  // Memory address, relocated if it is in thread space
+    OPERAND_TARGET    // Instruction number
+};
+
+// Operand kinds of param1 and param2, indexed by opcode
+static const OperandKind OPERAND_KINDS[][2] = {
+    {OPERAND_NONE, OPERAND_NONE},        // 0
+    {OPERAND_NONE, OPERAND_ADDRESS},     // SET B A
+    {OPERAND_ADDRESS, OPERAND_ADDRESS},  // CPY A1 A2
+    {OPERAND_ADDRESS, OPERAND_ADDRESS},  // CPYI A1 A2
+    {OPERAND_ADDRESS, OPERAND_NONE},     // ADD A B
+    {OPERAND_ADDRESS, OPERAND_ADDRESS},  // ADDI A1 A2
+    {OPERAND_ADDRESS, OPERAND_ADDRESS},  // SUBI A1 A2
+    {OPERAND_ADDRESS, OPERAND_TARGET},   // JIF A C
+    {OPERAND_ADDRESS, OPERAND_NONE},     // PUSH A
+    {OPERAND_ADDRESS, OPERAND_NONE},     // POP A
+    {OPERAND_TARGET, OPERAND_NONE},      // CALL C
+    {OPERAND_NONE, OPERAND_NONE},        // RET
+    {OPERAND_NONE, OPERAND_NONE},        // HLT
+    {OPERAND_NONE, OPERAND_NONE},        // USER
+    {OPERAND_NONE, OPERAND_NONE},        // SYSCALL type A, see syscallOperandKind
+    {OPERAND_ADDRESS, OPERAND_ADDRESS},  // BCPY A1 A2
+    {OPERAND_ADDRESS, OPERAND_NONE},     // BFIL A B
+    {OPERAND_ADDRESS, OPERAND_ADDRESS},  // BCMP A1 A2
+};
+static const int LINKED_OPCODES = sizeof(OPERAND_KINDS) / sizeof(OPERAND_KINDS[0]);
+
+// The SYSCALL parameter is an address for the message, semaphore, host
+// service and I/O calls (4-17); PRN prints it literally, HLT and YIELD
+// ignore it
+static OperandKind syscallOperandKind(int type) {
+    return type >= 4 && type <= 17 ? OPERAND_ADDRESS : OPERAND_NONE;
+}
+
+struct Relocation {
+    long base;        // Physical start of the thread's region
+    long addressing;  // Where the thread sees its region (base, or USER_VIRTUAL_BASE with --vm)
+};
+
+static long relocateOperand(OperandKind kind, long value, const Relocation& reloc) {
+    if (kind == OPERAND_TARGET) return reloc.addressing + THREAD_CODE_OFFSET + value;
+    if (kind == OPERAND_ADDRESS && value >= 1000) return value - 1000 + reloc.addressing;
+    return value;
+}
+
+static bool readImage(const std::string& filename, std::string& source) {
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return false;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    source = std::move(contents).str();
+    return true;
+}
+
+// Relocates one thread image into [reloc.base, reloc.base + 1000)
+static bool linkThread(CPU& cpu, const std::string& filename, const std::string& source, const Relocation& reloc) {
+    std::istringstream lines(source);
+    std::string line;
+    bool inDataSection = false, inInstructionSection = false;
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        if (line.find("Begin Data Section") != std::string::npos) {
+            inDataSection = true; inInstructionSection = false; continue;
+        } else if (line.find("End Data Section") != std::string::npos) {
+            inDataSection = false; continue;
+        } else if (line.find("Begin Instruction Section") != std::string::npos) {
+            inInstructionSection = true; inDataSection = false; continue;
+        } else if (line.find("End Instruction Section") != std::string::npos) {
+            inInstructionSection = false; continue;
+        }
+
+        std::istringstream iss(line);
+        if (inDataSection) {
+            long address, value;
+            if (!(iss >> address >> value)) continue;
+            if (address < 1000 || address >= 2000) {
+                std::cerr << "Error: " << filename << ": data address " << address
+                          << " is outside the thread region (1000-1999)" << std::endl;
+                return false;
+            }
+            cpu.setMemoryValue((int)(reloc.base + address - 1000), value);
+        } else if (inInstructionSection) {
+            // Same line format as CPU::loadProgramFromBuffer
+            int instructionNum; std::string opcode; int param1 = 0, param2 = 0;
+            if (!(iss >> instructionNum >> opcode)) continue;
+            if (!(iss >> param1)) param1 = 0;
+            if (!(iss >> param2)) param2 = 0;
+            if (instructionNum < 0 || instructionNum >= 1000 - THREAD_CODE_OFFSET) {
+                std::cerr << "Error: " << filename << ": instruction number out of thread region: "
+                          << instructionNum << std::endl;
+                return false;
+            }
+            int op = opcodeForMnemonic(opcode);
+            if (op < LINKED_OPCODES) {
+                param1 = (int)relocateOperand(OPERAND_KINDS[op][0], param1, reloc);
+                OperandKind kind2 = op == 14 ? syscallOperandKind(param1) : OPERAND_KINDS[op][1];
+                param2 = (int)relocateOperand(kind2, param2, reloc);
+            }
+            cpu.setMemoryValue((int)(reloc.base + THREAD_CODE_OFFSET + instructionNum),
+                               encodeInstruction(op, param1, param2));
+        }
+    }
+    return true;
+}
+
+bool CPU::linkProgram(const std::string& osFile, const std::vector<std::string>& threadFiles) {
+    if ((threadFiles.size() + 1) * 1000 > memory.size()) {
+        std::cerr << "Error: " << threadFiles.size() << " threads do not fit in " << memory.size()
+                  << " words of memory" << std::endl;
+        return false;
+    }
+    if (!loadProgram(osFile)) return false;
+
+    for (size_t i = 0; i < threadFiles.size(); i++) {
+        long id = (long)i + 1;
+        Relocation reloc = {id * 1000, virtualMemory ? USER_VIRTUAL_BASE : id * 1000};
+        std::string source, assembled;
+        if (!readImage(threadFiles[i], source)) return false;
+        // Labels resolve to instruction numbers, relocated below like numeric targets
+        if (needsAssembly(source)) {
+            if (!assembleProgram(source, 0, assembled)) return false;
+            source.swap(assembled);
+        }
+        if (!linkThread(*this, threadFiles[i], source, reloc)) return false;
+        if (debugMode > 0) {
+            std::cerr << "DEBUG: linkProgram - Linked " << threadFiles[i] << " as thread " << id << std::endl;
+        }
+    }
+
+    // Fill the OS thread table (os.txt layout) for the linked threads
+    long table = memory[OS_THREAD_TABLE_WORD];
+    long count = (long)threadFiles.size() + 1;
+    if (table > OS_STATE && table + count * THREAD_ENTRY_SIZE <= 1000) {
+        for (long id = 1; id < count; id++) {
+            long entry = table + id * THREAD_ENTRY_SIZE;
+            long space = virtualMemory ? USER_VIRTUAL_BASE : id * 1000;
+            long words[] = {id, 0, 0, READY, space + THREAD_CODE_OFFSET, space + 999, id * 1000, 0, 0};
+            std::copy(std::begin(words), std::end(words), memory.begin() + entry);
+        }
+        memory[OS_THREAD_COUNT_WORD] = count;
+    }
+
+    initializeThreadTable();
+    return true;
+}
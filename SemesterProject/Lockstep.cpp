@@ -0,0 +1,396 @@
+#include "Lockstep.h"
+#include <algorithm>
+#include <climits>
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define GTUSIM_LOCKSTEP_AVX2 1
+#endif
+
+// Row operations over n lanes
+struct RowKernels {
+    void (*set)(long* dst, long value, size_t n);
+    void (*copy)(long* dst, const long* src, size_t n);
+    void (*addImmediate)(long* dst, long value, size_t n);
+    void (*add)(long* dst, const long* src, size_t n);
+    void (*subtract)(long* dst, const long* a, const long* b, size_t n);
+};
+
+static void setScalar(long* dst, long value, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = value;
+}
+static void copyScalar(long* dst, const long* src, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = src[i];
+}
+static void addImmediateScalar(long* dst, long value, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] += value;
+}
+static void addScalar(long* dst, const long* src, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] += src[i];
+}
+static void subtractScalar(long* dst, const long* a, const long* b, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = a[i] - b[i];
+}
+
+static const RowKernels SCALAR_KERNELS = {setScalar, copyScalar, addImmediateScalar, addScalar, subtractScalar};
+
+#ifdef GTUSIM_LOCKSTEP_AVX2
+// Four 64-bit lanes per register, the tail falls back to scalar
+__attribute__((target("avx2"))) static void setAvx2(long* dst, long value, size_t n) {
+    __m256i v = _mm256_set1_epi64x(value);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm256_storeu_si256((__m256i*)(dst + i), v);
+    for (; i < n; i++) dst[i] = value;
+}
+__attribute__((target("avx2"))) static void copyAvx2(long* dst, const long* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_loadu_si256((const __m256i*)(src + i)));
+    }
+    for (; i < n; i++) dst[i] = src[i];
+}
+__attribute__((target("avx2"))) static void addImmediateAvx2(long* dst, long value, size_t n) {
+    __m256i v = _mm256_set1_epi64x(value);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_add_epi64(d, v));
+    }
+    for (; i < n; i++) dst[i] += value;
+}
+__attribute__((target("avx2"))) static void addAvx2(long* dst, const long* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_add_epi64(d, s));
+    }
+    for (; i < n; i++) dst[i] += src[i];
+}
+__attribute__((target("avx2"))) static void subtractAvx2(long* dst, const long* a, const long* b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_sub_epi64(x, y));
+    }
+    for (; i < n; i++) dst[i] = a[i] - b[i];
+}
+
+static const RowKernels AVX2_KERNELS = {setAvx2, copyAvx2, addImmediateAvx2, addAvx2, subtractAvx2};
+#endif
+
+bool LockstepEngine::hasAvx2() {
+#ifdef GTUSIM_LOCKSTEP_AVX2
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+static const RowKernels& rowKernels() {
+#ifdef GTUSIM_LOCKSTEP_AVX2
+    static const RowKernels& kernels = LockstepEngine::hasAvx2() ? AVX2_KERNELS : SCALAR_KERNELS;
+    return kernels;
+#else
+    return SCALAR_KERNELS;
+#endif
+}
+
+// Thread region of an address, as CPU::threadForAddress
+static long regionOf(long address) {
+    return address < 1000 ? 0 : address / 1000;
+}
+
+LockstepEngine::LockstepEngine()
+    : vectorSteps(0), scalarSteps(0), pendingPc(0), pendingInstructions(0), pendingCycles(0) {}
+
+bool LockstepEngine::addLane(CPU& cpu) {
+    if (!lanes.empty() && cpu.getMemorySize() != lanes[0]->getMemorySize()) {
+        std::cerr << "Error: Lockstep lanes need the same memory size (" << lanes[0]->getMemorySize()
+                  << " words)" << std::endl;
+        return false;
+    }
+    lanes.push_back(&cpu);
+    return true;
+}
+
+bool LockstepEngine::valid(size_t lane, long address) const {
+    return address > PC && address < (long)lanes[0]->getMemorySize() && (kernel[lane] || address >= 1000);
+}
+
+void LockstepEngine::refreshLane(size_t lane) {
+    kernel[lane] = lanes[lane]->isInKernelMode();
+    native[lane] = lanes[lane]->canRunNative();
+}
+
+void LockstepEngine::flushRetired() {
+    if (pendingInstructions == 0) return;
+    for (size_t l = 0; l < lanes.size(); l++) retire(l, pendingPc, pendingInstructions, pendingCycles);
+    pendingInstructions = 0;
+    pendingCycles = 0;
+}
+
+// One instruction for every lane, after sameInstruction(pc) with all lanes
+// in the shared block; false if it has to go lane by lane
+bool LockstepEngine::stepVector(long pc) {
+    size_t count = lanes.size();
+    long size = (long)lanes[0]->getMemorySize();
+    Instruction inst = decodeInstruction(row(pc)[0]);
+    long p1 = inst.param1, p2 = inst.param2;
+    switch (inst.opcode) {
+        case 1: if (!valid(0, p2)) return false; break;
+        case 2: case 5: case 6: if (!valid(0, p1) || !valid(0, p2)) return false; break;
+        case 3:
+            if (!valid(0, p1) || !valid(0, p2)) return false;
+            for (size_t l = 0; l < count; l++) {
+                if (!valid(l, row(p1)[l])) return false;
+            }
+            break;
+        case 4: case 7: if (!valid(0, p1)) return false; break;
+        default: return false;
+    }
+
+    if (pendingInstructions > 0 && regionOf(pc) != regionOf(pendingPc)) flushRetired();
+    if (pendingInstructions == 0) pendingPc = pc;
+    pendingInstructions++;
+    pendingCycles += lanes[0]->getCycleCost(inst.opcode);
+
+    const RowKernels& k = rowKernels();
+    k.addImmediate(row(INSTR_CNT), 1, count);
+    switch (inst.opcode) {
+        case 1: k.set(row(p2), p1, count); break;
+        case 2: k.copy(row(p2), row(p1), count); break;
+        case 3:
+            for (size_t l = 0; l < count; l++) row(p2)[l] = row(row(p1)[l])[l];
+            break;
+        case 4: k.addImmediate(row(p1), p2, count); break;
+        case 5: k.add(row(p1), row(p2), count); break;
+        case 6: k.subtract(row(p2), row(p1), row(p2), count); break;
+        case 7:
+            for (size_t l = 0; l < count; l++) {
+                bool jump = row(p1)[l] <= 0 && p2 >= THREAD_CODE_OFFSET && p2 < size &&
+                            decodeInstruction(row(p2)[l]).opcode != 0;
+                row(PC)[l] = jump ? p2 : pc + 1;
+            }
+            break;
+    }
+    if (inst.opcode != 7) k.set(row(PC), pc + 1, count);
+    long target = inst.opcode == 4 || inst.opcode == 5 ? p1 : p2;
+    for (size_t l = 0; l < count; l++) {
+        steps[l]++;
+        touch(l, INSTR_CNT);
+        touch(l, PC);
+        if (inst.opcode != 7) touch(l, target);
+    }
+    vectorSteps++;
+    return true;
+}
+
+// One instruction for one lane, wherever its memory is; false if the
+// interpreter has to run it
+bool LockstepEngine::stepNative(size_t lane, long pc) {
+    size_t count = lanes.size();
+    long size = (long)lanes[0]->getMemorySize();
+    if (!native[lane] || pc < 0 || pc >= size) return false;
+    long* own = inCpu[lane] ? lanes[lane]->nativeMemory() : nullptr;
+    auto at = [&](long address) -> long& { return own ? own[address] : words[address * count + lane]; };
+    Instruction inst = decodeInstruction(at(pc));
+    long p1 = inst.param1, p2 = inst.param2;
+    switch (inst.opcode) {
+        case 1: if (!valid(lane, p2)) return false; break;
+        case 2: case 5: case 6: if (!valid(lane, p1) || !valid(lane, p2)) return false; break;
+        case 3: if (!valid(lane, p1) || !valid(lane, p2) || !valid(lane, at(p1))) return false; break;
+        case 4: case 7: if (!valid(lane, p1)) return false; break;
+        default: return false;
+    }
+
+    at(INSTR_CNT)++;
+    long next = pc + 1;
+    switch (inst.opcode) {
+        case 1: at(p2) = p1; break;
+        case 2: at(p2) = at(p1); break;
+        case 3: at(p2) = at(at(p1)); break;
+        case 4: at(p1) += p2; break;
+        case 5: at(p1) += at(p2); break;
+        case 6: at(p2) = at(p1) - at(p2); break;
+        case 7:
+            if (at(p1) <= 0 && p2 >= THREAD_CODE_OFFSET && p2 < size && decodeInstruction(at(p2)).opcode != 0) {
+                next = p2;
+            }
+            break;
+    }
+    at(PC) = next;
+    touch(lane, INSTR_CNT);
+    touch(lane, PC);
+    if (inst.opcode != 7) touch(lane, inst.opcode == 4 || inst.opcode == 5 ? p1 : p2);
+    retire(lane, pc, 1, lanes[lane]->getCycleCost(inst.opcode));
+    scalarSteps++;
+    return true;
+}
+
+// Lists a word the lane wrote where its memory is now
+void LockstepEngine::touch(size_t lane, long address) {
+    char& mark = written[address * lanes.size() + lane];
+    if (mark) return;
+    mark = 1;
+    writes[lane].push_back(address);
+}
+
+// Copies the listed words from where the lane's memory is to the other side
+void LockstepEngine::copyWrites(size_t lane) {
+    size_t count = lanes.size();
+    long* own = lanes[lane]->nativeMemory();
+    for (long a : writes[lane]) {
+        long& shared = words[a * count + lane];
+        if (inCpu[lane]) shared = own[a];
+        else own[a] = shared;
+        written[a * count + lane] = 0;
+    }
+    writes[lane].clear();
+}
+
+// Moves a lane's memory between its CPU and the shared block. A lane stays
+// in its CPU across interpreted steps and only comes back for native ones.
+void LockstepEngine::moveToCpu(size_t lane) {
+    if (inCpu[lane]) return;
+    copyWrites(lane);
+    inCpu[lane] = 1;
+}
+
+void LockstepEngine::moveToShared(size_t lane) {
+    if (!inCpu[lane]) return;
+    if (rewritten[lane]) {
+        size_t count = lanes.size();
+        const MemoryVector& memory = lanes[lane]->getMemory();
+        for (size_t a = 0; a < memory.size(); a++) words[a * count + lane] = memory[a];
+        rewritten[lane] = 0;
+    }
+    copyWrites(lane);
+    inCpu[lane] = 0;
+}
+
+// retireNative for one lane. A thread state change writes the OS thread
+// table in the CPU's memory, so a lane in the shared block brings its CPU
+// up to date first and copies the table's time words back into the rows.
+void LockstepEngine::retire(size_t lane, long pc, long instructions, long cycles) {
+    CPU& cpu = *lanes[lane];
+    long table = cpu.getThreadTableAddress();
+    if (inCpu[lane] || table <= 0) {
+        cpu.retireNative(pc, instructions, cycles);
+        return;
+    }
+    copyWrites(lane);
+    cpu.retireNative(pc, instructions, cycles);
+    size_t count = lanes.size();
+    const MemoryVector& memory = cpu.getMemory();
+    for (size_t t = 0; t < cpu.getThreadTable().size(); t++) {
+        for (long word : {THREAD_LAST_EXEC_WORD, THREAD_BLOCKED_TIME_WORD}) {
+            long address = table + (long)t * THREAD_ENTRY_SIZE + word;
+            if (address < (long)memory.size()) words[address * count + lane] = memory[address];
+        }
+    }
+}
+
+long LockstepEngine::laneWord(size_t lane, long address) const {
+    return inCpu[lane] ? lanes[lane]->getMemory()[address] : words[address * lanes.size() + lane];
+}
+
+// Whether all lanes hold the same data instruction at pc, checked before
+// moving lanes back into the shared block
+bool LockstepEngine::sameInstruction(long pc) const {
+    if (pc < 0 || pc >= (long)lanes[0]->getMemorySize()) return false;
+    long word = laneWord(0, pc);
+    int opcode = decodeInstruction(word).opcode;
+    if (opcode < 1 || opcode > 7) return false;
+    for (size_t l = 0; l < lanes.size(); l++) {
+        if (!native[l] || kernel[l] != kernel[0] || laneWord(l, pc) != word) return false;
+    }
+    return true;
+}
+
+// Runs one instruction in the lane's CPU and lists the words it can have
+// written: the registers, its operands, the stack slot below SP and the
+// thread table's time words. Syscalls, block instructions, interrupts and
+// lanes that cannot run natively (VM, scheduler) may write anywhere, so
+// their whole memory goes back to the shared block.
+void LockstepEngine::stepInterpreted(size_t lane) {
+    moveToCpu(lane);
+    CPU& cpu = *lanes[lane];
+    const MemoryVector& memory = cpu.getMemory();
+    long size = (long)memory.size();
+    long pc = memory[PC], sp = memory[SP];
+    Instruction inst = decodeInstruction(pc >= 0 && pc < size ? memory[pc] : 0);
+    bool listed = native[lane] && inst.opcode >= 1 && inst.opcode <= 13;
+    long interrupts = cpu.getInterruptCount();
+    cpu.step();
+    if (!listed || cpu.getInterruptCount() != interrupts) rewritten[lane] = 1;
+    if (!rewritten[lane]) {
+        for (long r = PC; r <= OS_STATE; r++) touch(lane, r);
+        for (long address : {(long)inst.param1, (long)inst.param2, sp - 1}) {
+            if (address > OS_STATE && address < size) touch(lane, address);
+        }
+        long table = cpu.getThreadTableAddress();
+        for (size_t t = 0; table > 0 && t < cpu.getThreadTable().size(); t++) {
+            for (long word : {THREAD_LAST_EXEC_WORD, THREAD_BLOCKED_TIME_WORD}) {
+                long address = table + (long)t * THREAD_ENTRY_SIZE + word;
+                if (address < size) touch(lane, address);
+            }
+        }
+    }
+    refreshLane(lane);
+    scalarSteps++;
+}
+
+long LockstepEngine::run(long maxSteps) {
+    size_t count = lanes.size();
+    if (count == 0) return 0;
+    size_t size = lanes[0]->getMemorySize();
+    words.assign(size * count, 0);
+    for (size_t l = 0; l < count; l++) {
+        const MemoryVector& memory = lanes[l]->getMemory();
+        for (size_t a = 0; a < size; a++) words[a * count + l] = memory[a];
+    }
+    steps.assign(count, 0);
+    inCpu.assign(count, 0);
+    kernel.assign(count, 0);
+    native.assign(count, 0);
+    writes.resize(count);
+    for (std::vector<long>& list : writes) list.clear();
+    written.assign(size * count, 0);
+    rewritten.assign(count, 0);
+    for (size_t l = 0; l < count; l++) refreshLane(l);
+
+    long total = 0;
+    for (;;) {
+        // Lowest PC among the lanes still running
+        long pc = LONG_MAX;
+        size_t running = 0;
+        bool agree = true;
+        for (size_t l = 0; l < count; l++) {
+            if (lanes[l]->isHalted() || (maxSteps >= 0 && steps[l] >= maxSteps)) continue;
+            long at = laneWord(l, PC);
+            if (running > 0 && at != pc) agree = false;
+            pc = std::min(pc, at);
+            running++;
+        }
+        if (running == 0) break;
+        if (running == count && agree && sameInstruction(pc)) {
+            for (size_t l = 0; l < count; l++) moveToShared(l);
+            if (stepVector(pc)) {
+                total += (long)count;
+                continue;
+            }
+        }
+        flushRetired();
+        for (size_t l = 0; l < count; l++) {
+            if (lanes[l]->isHalted() || (maxSteps >= 0 && steps[l] >= maxSteps) || laneWord(l, PC) != pc) continue;
+            if (!stepNative(l, pc)) stepInterpreted(l);
+            steps[l]++;
+            total++;
+        }
+    }
+    flushRetired();
+
+    for (size_t l = 0; l < count; l++) moveToCpu(l);
+    return total;
+}
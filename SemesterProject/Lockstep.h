@@ -0,0 +1,73 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include "CPU.h"
+#include <vector>
+
+// Runs several CPUs that execute the same program on different data in
+// lockstep. While run() is active their memories live in one
+// structure-of-arrays block: word a of lane l is words[a * lanes + l], so
+// one instruction reads and writes a contiguous row for all lanes.
+//
+// When every lane is at the same PC with the same instruction word,
+// SET, CPY, ADD, ADDI and SUBI run across the row with AVX2 if the host
+// has it (checked at run time), else with plain loops; CPYI and JIF go lane
+// by lane. Lanes whose PCs differ step one at a time, lowest PC first, so
+// they tend to meet again. Anything else (syscalls, stack, faults, mode
+// switches) is interpreted by the lane's own CPU; the lane's memory moves
+// into that CPU until the lanes agree again. A move copies only the words
+// written since the last one, and the whole lane only after instructions
+// that can write anywhere (syscalls, block instructions, interrupts). Each
+// lane ends exactly as if it had run alone.
+class LockstepEngine {
+public:
+    LockstepEngine();
+
+    // Lanes must share a memory size and be set up (program loaded) before run()
+    bool addLane(CPU& cpu);
+    size_t getLaneCount() const { return lanes.size(); }
+
+    // Runs every lane until it halts or has run maxSteps instructions;
+    // returns the instructions executed over all lanes
+    long run(long maxSteps = -1);
+
+    static bool hasAvx2();
+    long getVectorSteps() const { return vectorSteps; }  // Instructions run for all lanes at once
+    long getScalarSteps() const { return scalarSteps; }  // Instructions run for one lane
+
+private:
+    std::vector<CPU*> lanes;
+    std::vector<long> words;   // Structure-of-arrays memory
+    std::vector<long> steps;   // Per lane
+    std::vector<char> inCpu;   // Per lane: memory is in the lane's CPU, not in words
+    std::vector<char> kernel;  // Per lane mode, refreshed after each interpreted step
+    std::vector<char> native;  // Per lane CPU::canRunNative
+    // Per lane: words written where the lane's memory is now, to copy on the
+    // next move. written marks them (same layout as words) so each is listed once.
+    std::vector<std::vector<long>> writes;
+    std::vector<char> written;
+    std::vector<char> rewritten;  // Per lane: the CPU may have written any word
+    long vectorSteps;
+    long scalarSteps;
+    // Retirement of vector steps is batched while the PC stays in one thread region
+    long pendingPc;
+    long pendingInstructions;
+    long pendingCycles;
+
+    long* row(long address) { return &words[address * lanes.size()]; }
+    bool valid(size_t lane, long address) const;
+    bool stepVector(long pc);
+    bool stepNative(size_t lane, long pc);
+    void stepInterpreted(size_t lane);
+    void moveToCpu(size_t lane);
+    void moveToShared(size_t lane);
+    void touch(size_t lane, long address);
+    void copyWrites(size_t lane);
+    void retire(size_t lane, long pc, long instructions, long cycles);
+    long laneWord(size_t lane, long address) const;
+    bool sameInstruction(long pc) const;
+    void flushRetired();
+    void refreshLane(size_t lane);
+};
+
+#endif // LOCKSTEP_H
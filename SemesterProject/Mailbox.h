@@ -0,0 +1,39 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+// Bounded FIFO of one-word messages for a simulated thread (SEND/RECV).
+// A fixed ring buffer: push fails when it is full, pop when it is empty.
+class Mailbox {
+public:
+    static const int CAPACITY = 16;
+
+    Mailbox() : head(0), count(0) {}
+
+    bool push(long sender, long value) {
+        if (count == CAPACITY) return false;
+        int tail = (head + count) % CAPACITY;
+        senders[tail] = sender;
+        values[tail] = value;
+        count++;
+        return true;
+    }
+
+    bool pop(long& sender, long& value) {
+        if (count == 0) return false;
+        sender = senders[head];
+        value = values[head];
+        head = (head + 1) % CAPACITY;
+        count--;
+        return true;
+    }
+
+    int size() const { return count; }
+
+private:
+    long senders[CAPACITY];
+    long values[CAPACITY];
+    int head;
+    int count;
+};
+
+#endif // MAILBOX_H
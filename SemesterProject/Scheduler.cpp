@@ -0,0 +1,121 @@
+#include "Scheduler.h"
+#include <algorithm>
+
+void RoundRobinScheduler::add(int threadId, int priority) {
+    (void)priority;
+    queue.push_back(threadId);
+}
+
+int RoundRobinScheduler::pickNext() {
+    if (queue.empty()) return -1;
+    int threadId = queue.front();
+    queue.pop_front();
+    return threadId;
+}
+
+void PriorityScheduler::add(int threadId, int priority) {
+    ready.insert(std::make_tuple(-priority, sequence++, threadId));
+}
+
+int PriorityScheduler::pickNext() {
+    if (ready.empty()) return -1;
+    int threadId = std::get<2>(*ready.begin());
+    ready.erase(ready.begin());
+    return threadId;
+}
+
+MLFQScheduler::MLFQScheduler(long quantum, int threadCount)
+    : Scheduler(quantum), level(threadCount, 0), picks(0) {
+}
+
+void MLFQScheduler::add(int threadId, int priority) {
+    (void)priority;
+    queues[level[threadId]].push_back(threadId);
+}
+
+int MLFQScheduler::pickNext() {
+    // Periodic boost keeps long-running threads from starving
+    if (++picks % BOOST_INTERVAL == 0) {
+        for (int l = 1; l < LEVELS; l++) {
+            for (int threadId : queues[l]) {
+                level[threadId] = 0;
+                queues[0].push_back(threadId);
+            }
+            queues[l].clear();
+        }
+    }
+    for (int l = 0; l < LEVELS; l++) {
+        if (!queues[l].empty()) {
+            int threadId = queues[l].front();
+            queues[l].pop_front();
+            return threadId;
+        }
+    }
+    return -1;
+}
+
+void MLFQScheduler::clear() {
+    for (int l = 0; l < LEVELS; l++) queues[l].clear();
+    std::fill(level.begin(), level.end(), 0);
+    picks = 0;
+}
+
+void MLFQScheduler::onQuantumExpired(int threadId) {
+    if (level[threadId] < LEVELS - 1) level[threadId]++;
+}
+
+long MLFQScheduler::quantumFor(int threadId) const {
+    return baseQuantum << level[threadId];
+}
+
+LotteryScheduler::LotteryScheduler(long quantum, int threadCount, unsigned seed)
+    : Scheduler(quantum), tree(threadCount + 1, 0), tickets(threadCount, 0),
+      totalTickets(0), rng(seed) {
+}
+
+void LotteryScheduler::update(int threadId, long delta) {
+    for (size_t i = threadId + 1; i < tree.size(); i += i & (~i + 1)) {
+        tree[i] += delta;
+    }
+    tickets[threadId] += delta;
+    totalTickets += delta;
+}
+
+void LotteryScheduler::add(int threadId, int priority) {
+    long count = priority < 0 ? 1 : (long)priority + 1;
+    update(threadId, count - tickets[threadId]);
+}
+
+int LotteryScheduler::pickNext() {
+    if (totalTickets == 0) return -1;
+    long winner = std::uniform_int_distribution<long>(0, totalTickets - 1)(rng);
+
+    // Descend the Fenwick tree to the thread holding the winning ticket
+    size_t position = 0;
+    size_t step = 1;
+    while (step * 2 < tree.size()) step *= 2;
+    for (; step > 0; step /= 2) {
+        if (position + step < tree.size() && tree[position + step] <= winner) {
+            position += step;
+            winner -= tree[position];
+        }
+    }
+    int threadId = (int)position;
+    update(threadId, -tickets[threadId]);
+    return threadId;
+}
+
+void LotteryScheduler::clear() {
+    std::fill(tree.begin(), tree.end(), 0);
+    std::fill(tickets.begin(), tickets.end(), 0);
+    totalTickets = 0;
+}
+
+std::unique_ptr<Scheduler> createScheduler(const std::string& name, long quantum,
+                                           int threadCount, unsigned seed) {
+    if (name == "rr") return std::unique_ptr<Scheduler>(new RoundRobinScheduler(quantum));
+    if (name == "priority") return std::unique_ptr<Scheduler>(new PriorityScheduler(quantum));
+    if (name == "mlfq") return std::unique_ptr<Scheduler>(new MLFQScheduler(quantum, threadCount));
+    if (name == "lottery") return std::unique_ptr<Scheduler>(new LotteryScheduler(quantum, threadCount, seed));
+    return nullptr;
+}
@@ -0,0 +1,107 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <deque>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Chooses the next READY thread when the simulator schedules threads
+// itself (simulate --sched). The running thread is never in the ready set:
+// the CPU adds a thread when it becomes READY and pickNext removes it.
+class Scheduler {
+public:
+    explicit Scheduler(long quantum) : baseQuantum(quantum) {}
+    virtual ~Scheduler() {}
+
+    virtual const char* name() const = 0;
+    virtual void add(int threadId, int priority) = 0;
+    virtual int pickNext() = 0;  // -1 if no thread is ready
+    virtual void clear() = 0;
+    // Called before a thread that used up its quantum is put back
+    virtual void onQuantumExpired(int threadId) { (void)threadId; }
+    // Cycles the thread may run before it is preempted
+    virtual long quantumFor(int threadId) const { (void)threadId; return baseQuantum; }
+
+protected:
+    long baseQuantum;
+};
+
+// FIFO ready queue, O(1)
+class RoundRobinScheduler : public Scheduler {
+public:
+    explicit RoundRobinScheduler(long quantum) : Scheduler(quantum) {}
+    const char* name() const override { return "rr"; }
+    void add(int threadId, int priority) override;
+    int pickNext() override;
+    void clear() override { queue.clear(); }
+
+private:
+    std::deque<int> queue;
+};
+
+// Highest priority first, FIFO among equals, O(log n)
+class PriorityScheduler : public Scheduler {
+public:
+    explicit PriorityScheduler(long quantum) : Scheduler(quantum), sequence(0) {}
+    const char* name() const override { return "priority"; }
+    void add(int threadId, int priority) override;
+    int pickNext() override;
+    void clear() override { ready.clear(); }
+
+private:
+    // (-priority, arrival sequence, thread id)
+    std::set<std::tuple<int, long, int>> ready;
+    long sequence;
+};
+
+// Multi-level feedback queue: threads start at the top level, drop a level
+// when they use a full quantum and are boosted back to the top every
+// BOOST_INTERVAL picks. Lower levels get longer quanta. O(1) per operation.
+class MLFQScheduler : public Scheduler {
+public:
+    static const int LEVELS = 3;
+    static const long BOOST_INTERVAL = 100;
+
+    MLFQScheduler(long quantum, int threadCount);
+    const char* name() const override { return "mlfq"; }
+    void add(int threadId, int priority) override;
+    int pickNext() override;
+    void clear() override;
+    void onQuantumExpired(int threadId) override;
+    long quantumFor(int threadId) const override;
+
+private:
+    std::deque<int> queues[LEVELS];
+    std::vector<int> level;  // Current level per thread
+    long picks;
+};
+
+// Lottery scheduling with priority + 1 tickets per thread. Ticket sums are
+// kept in a Fenwick tree so drawing a winner is O(log n).
+class LotteryScheduler : public Scheduler {
+public:
+    LotteryScheduler(long quantum, int threadCount, unsigned seed);
+    const char* name() const override { return "lottery"; }
+    void add(int threadId, int priority) override;
+    int pickNext() override;
+    void clear() override;
+
+private:
+    std::vector<long> tree;     // Fenwick tree over ticket counts, 1-based
+    std::vector<long> tickets;  // Tickets of each ready thread, 0 if not ready
+    long totalTickets;
+    std::mt19937 rng;
+
+    void update(int threadId, long delta);
+};
+
+// Creates a scheduler by name (rr, priority, mlfq, lottery), nullptr if unknown
+std::unique_ptr<Scheduler> createScheduler(const std::string& name, long quantum,
+                                           int threadCount, unsigned seed);
+
+#endif // SCHEDULER_H
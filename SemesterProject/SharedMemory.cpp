@@ -0,0 +1,110 @@
+#include "SharedMemory.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Snapshot attempts before a reader gives up on a writer stuck mid-update
+static const int SNAPSHOT_ATTEMPTS = 10000;
+
+// shm_open names start with a single slash
+static std::string segmentName(const std::string& name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+SharedSegment::SharedSegment(const std::string& name, void* base, size_t bytes, bool owner)
+    : name(name), base(base), bytes(bytes), owner(owner), header(static_cast<SharedHeader*>(base)) {}
+
+SharedSegment::~SharedSegment() {
+    munmap(base, bytes);
+    if (owner) shm_unlink(name.c_str());
+}
+
+void SharedSegment::publish(const SharedStatus& status) {
+    uint64_t sequence = header->sequence.load(std::memory_order_relaxed);
+    header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    size_t used = offsetof(SharedStatus, threads) + (size_t)status.threadCount * sizeof(SharedThreadStatus);
+    std::memcpy(&header->status, &status, used);
+    header->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool SharedSegment::snapshot(SharedStatus& status) const {
+    for (int attempt = 0; attempt < SNAPSHOT_ATTEMPTS; attempt++) {
+        uint64_t before = header->sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+        std::memcpy(&status, &header->status, sizeof(status));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->sequence.load(std::memory_order_relaxed) == before) {
+            if (status.threadCount < 0 || status.threadCount > SHARED_MAX_THREADS) status.threadCount = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::unique_ptr<SharedSegment> createSharedSegment(const std::string& name, size_t memoryWords) {
+    std::string path = segmentName(name);
+    size_t bytes = SHARED_HEADER_BYTES + memoryWords * sizeof(long);
+    shm_unlink(path.c_str());
+    int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        std::cerr << "Error: Could not create shared memory " << path << ": " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    if (ftruncate(fd, (off_t)bytes) != 0) {
+        std::cerr << "Error: Could not size shared memory " << path << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        shm_unlink(path.c_str());
+        return nullptr;
+    }
+    void* base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "Error: Could not map shared memory " << path << ": " << std::strerror(errno) << std::endl;
+        shm_unlink(path.c_str());
+        return nullptr;
+    }
+    // The new segment is zero-filled, so the sequence starts at 0
+    SharedHeader* header = static_cast<SharedHeader*>(base);
+    header->memoryWords = memoryWords;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SHARED_MAGIC;
+    return std::make_unique<SharedSegment>(path, base, bytes, true);
+}
+
+std::unique_ptr<SharedSegment> attachSharedSegment(const std::string& name) {
+    std::string path = segmentName(name);
+    int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        std::cerr << "Error: Could not open shared memory " << path << ": " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < SHARED_HEADER_BYTES) {
+        std::cerr << "Error: " << path << " is not a simulator segment" << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    size_t bytes = (size_t)info.st_size;
+    void* base = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "Error: Could not map shared memory " << path << ": " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    const SharedHeader* header = static_cast<const SharedHeader*>(base);
+    if (header->magic != SHARED_MAGIC || SHARED_HEADER_BYTES + header->memoryWords * sizeof(long) > bytes) {
+        std::cerr << "Error: " << path << " is not a simulator segment" << std::endl;
+        munmap(base, bytes);
+        return nullptr;
+    }
+    return std::make_unique<SharedSegment>(path, base, bytes, false);
+}
@@ -0,0 +1,116 @@
+#ifndef SHARED_MEMORY_H
+#define SHARED_MEMORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Live view of a running simulation for other processes (simulate --shm,
+// gtutop). A POSIX shared-memory segment holds a header followed by the
+// CPU's memory words, so the memory itself is always current. The header
+// carries a status snapshot (PC, counters, thread states) that the CPU
+// republishes every SHARED_PUBLISH_INTERVAL instructions and when it halts.
+// The snapshot is guarded by a seqlock: the writer never waits, and readers
+// retry when the sequence number was odd or changed while they copied.
+
+const uint64_t SHARED_MAGIC = 0x31304d4953555447;  // "GTUSIM01"
+const int SHARED_MAX_THREADS = 64;
+const long SHARED_PUBLISH_INTERVAL = 4096;
+
+struct SharedThreadStatus {
+    int64_t state;           // ThreadState
+    int64_t pc;              // Saved PC, the live PC for the running thread
+    int64_t instructions;
+    int64_t executionCount;
+};
+
+struct SharedStatus {
+    int64_t pc;
+    int64_t instructionCount;
+    int64_t cycleCount;
+    int64_t contextSwitches;
+    int64_t currentThread;
+    int64_t kernelMode;
+    int64_t halted;
+    int64_t threadCount;     // Entries used in threads
+    SharedThreadStatus threads[SHARED_MAX_THREADS];
+};
+
+struct SharedHeader {
+    uint64_t magic;
+    uint64_t memoryWords;
+    std::atomic<uint64_t> sequence;  // Odd while the status is being written
+    SharedStatus status;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "seqlock needs a lock-free counter");
+
+// Memory words start on the first page after the header
+const size_t SHARED_HEADER_BYTES = (sizeof(SharedHeader) + 4095) / 4096 * 4096;
+
+class SharedSegment {
+public:
+    SharedSegment(const std::string& name, void* base, size_t bytes, bool owner);
+    ~SharedSegment();  // Unmaps; the creator also removes the name
+    SharedSegment(const SharedSegment&) = delete;
+    SharedSegment& operator=(const SharedSegment&) = delete;
+
+    const std::string& getName() const { return name; }
+    size_t getMemoryWords() const { return header->memoryWords; }
+    long* words() { return reinterpret_cast<long*>(static_cast<char*>(base) + SHARED_HEADER_BYTES); }
+    const long* words() const { return reinterpret_cast<const long*>(static_cast<const char*>(base) + SHARED_HEADER_BYTES); }
+
+    // Writer side, only the creator may publish
+    void publish(const SharedStatus& status);
+    // Consistent copy of the last published status, false if the writer
+    // stayed in the middle of an update (e.g. it was killed there)
+    bool snapshot(SharedStatus& status) const;
+
+private:
+    std::string name;
+    void* base;
+    size_t bytes;
+    bool owner;
+    SharedHeader* header;
+};
+
+// Creates the named segment for memoryWords words, replacing a stale one
+// with the same name; nullptr on error
+std::unique_ptr<SharedSegment> createSharedSegment(const std::string& name, size_t memoryWords);
+// Maps an existing segment read-only; nullptr on error
+std::unique_ptr<SharedSegment> attachSharedSegment(const std::string& name);
+
+// Allocator for the CPU's memory vector. Without a segment it uses the
+// heap; with one, an allocation that fits is the segment's word array.
+// Copies of the vector go back to the heap.
+class MemoryAllocator {
+public:
+    using value_type = long;
+    using propagate_on_container_move_assignment = std::true_type;
+    template <typename U> struct rebind { using other = MemoryAllocator; };
+
+    MemoryAllocator() : shared(nullptr), capacity(0) {}
+    MemoryAllocator(long* shared, size_t capacity) : shared(shared), capacity(capacity) {}
+
+    long* allocate(size_t n) {
+        if (shared && n <= capacity) return shared;
+        return std::allocator<long>().allocate(n);
+    }
+    void deallocate(long* p, size_t n) {
+        if (p != shared) std::allocator<long>().deallocate(p, n);
+    }
+    MemoryAllocator select_on_container_copy_construction() const { return MemoryAllocator(); }
+    bool operator==(const MemoryAllocator& other) const { return shared == other.shared; }
+
+private:
+    long* shared;
+    size_t capacity;
+};
+
+using MemoryVector = std::vector<long, MemoryAllocator>;
+
+#endif // SHARED_MEMORY_H
@@ -0,0 +1,226 @@
+// Differential fuzzer for the GTU-C312 interpreter.
+//
+// Each input is turned into a random GTU-C312 program that runs on the
+// reference engine (CPU::step one instruction at a time) and on every
+// other engine in the table below. Final memory, halt state and PRN output
+// must match; a mismatch aborts so libFuzzer keeps the input.
+//
+// Built with clang and GTUSIM_LIBFUZZER=ON this is a libFuzzer target.
+// Otherwise it is a standalone driver:
+//   fuzz_interpreter [iterations] [seed]   run random inputs
+//   fuzz_interpreter <file>...              replay saved inputs
+#include "CPU.h"
+#include "HostServices.h"
+#include "Jit.h"
+#include "Lockstep.h"
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+static const long MAX_STEPS = 20000;
+static const int CODE_START = 100;
+static const int DATA_START = 1000;
+
+struct Engine {
+    const char* name;
+    void (*run)(CPU& cpu, long maxSteps);
+};
+
+static void runReference(CPU& cpu, long maxSteps) {
+    for (long i = 0; i < maxSteps && cpu.step(); i++) {
+    }
+}
+
+static void runBatch(CPU& cpu, long maxSteps) {
+    cpu.run(maxSteps);
+}
+
+// Threshold 1 compiles every block on first use
+static void runJit(CPU& cpu, long maxSteps) {
+    Jit jit(1);
+    jit.run(cpu, maxSteps);
+}
+
+// The CPU under test is lane 0 of four; lane 1 has the same data and
+// lanes 2 and 3 different data, so the lanes both agree and diverge
+static void runLockstep(CPU& cpu, long maxSteps) {
+    CPU others[3];
+    LockstepEngine engine;
+    engine.addLane(cpu);
+    for (int i = 0; i < 3; i++) {
+        registerHostServices(others[i]);
+        others[i].setSyscallHook([](CPU&, int type, long) { return type == 1; });
+        others[i].writeMemory(0, cpu.getMemory());
+        for (int a = DATA_START; i > 0 && a < DATA_START + 64; a++) {
+            others[i].setMemoryValue(a, cpu.getMemoryValue(a) + i);
+        }
+        engine.addLane(others[i]);
+    }
+    engine.run(maxSteps);
+}
+
+// Engines compared against the reference, first entry is the reference
+static const Engine ENGINES[] = {
+    {"reference", runReference},
+    {"run", runBatch},
+    {"jit", runJit},
+    {"lockstep", runLockstep},
+};
+
+struct Outcome {
+    std::vector<long> memory;
+    std::vector<long> output;
+    bool halted;
+};
+
+// Maps a byte stream onto a program: 5 bytes per instruction, operands
+// folded into the registers, the code area and a small data area so that
+// most instructions touch interesting memory.
+class ProgramBuilder {
+public:
+    ProgramBuilder(const uint8_t* data, size_t size) : data(data), size(size), pos(0) {}
+
+    std::vector<long> build() {
+        std::vector<long> code;
+        while (pos + 5 <= size && code.size() < 200) {
+            int op = next() % 19;  // 0 and 18 are invalid opcodes
+            int a = next(), b = next(), c = next(), d = next();
+            code.push_back(encodeInstruction(op, operand1(op, a, b), operand2(op, c, d, code.size())));
+        }
+        return code;
+    }
+
+    std::vector<long> dataWords() {
+        std::vector<long> words;
+        while (pos < size && words.size() < 64) {
+            words.push_back((long)(int8_t)next());
+        }
+        return words;
+    }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+
+    int next() { return pos < size ? data[pos++] : 0; }
+
+    static int address(int a, int b) {
+        switch (a % 8) {
+            case 0: return b % 21;                 // registers
+            case 1: return CODE_START + b % 64;    // code (self-modifying)
+            default: return DATA_START + b % 64;   // data
+        }
+    }
+
+    static int operand1(int op, int a, int b) {
+        if (op == 14) {  // SYSCALL type: PRN, HLT, YIELD or a host service
+            static const int types[] = {1, 1, 2, 3, 10, 11, 12, 13, 14, 99};
+            return types[b % 10];
+        }
+        if (op == 10) return CODE_START + b % 64;  // CALL target
+        return address(a, b);
+    }
+
+    static int operand2(int op, int c, int d, size_t index) {
+        if (op == 1 || op == 4 || op == 16) return (int8_t)d;  // immediates
+        if (op == 7) return CODE_START + (d % 2 ? d % 64 : (int)index + 1 + d % 4);  // JIF target
+        return address(c, d);
+    }
+};
+
+static Outcome runEngine(const Engine& engine, const std::vector<long>& code, const std::vector<long>& words) {
+    CPU cpu;
+    registerHostServices(cpu);
+    Outcome outcome;
+    cpu.setSyscallHook([&outcome](CPU&, int type, long param) {
+        if (type != 1) return false;
+        outcome.output.push_back(param);
+        return true;
+    });
+    cpu.writeMemory(CODE_START, code);
+    cpu.writeMemory(DATA_START, words);
+    cpu.setMemoryValue(PC, CODE_START);
+    cpu.setMemoryValue(SP, cpu.getThreadTable()[0].stackTop);
+    engine.run(cpu, MAX_STEPS);
+
+    outcome.memory.assign(cpu.getMemory().begin(), cpu.getMemory().end());
+    outcome.halted = cpu.isHalted();
+    return outcome;
+}
+
+static void compare(const Engine& engine, const Outcome& expected, const Outcome& actual) {
+    if (expected.halted != actual.halted) {
+        std::cerr << "MISMATCH (" << engine.name << "): halted " << actual.halted
+                  << ", reference " << expected.halted << std::endl;
+        std::abort();
+    }
+    if (expected.output != actual.output) {
+        std::cerr << "MISMATCH (" << engine.name << "): PRN output differs" << std::endl;
+        std::abort();
+    }
+    for (size_t i = 0; i < expected.memory.size(); i++) {
+        if (expected.memory[i] != actual.memory[i]) {
+            std::cerr << "MISMATCH (" << engine.name << "): memory[" << i << "] = " << actual.memory[i]
+                      << ", reference " << expected.memory[i] << std::endl;
+            std::abort();
+        }
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    ProgramBuilder builder(data, size);
+    std::vector<long> code = builder.build();
+    std::vector<long> words = builder.dataWords();
+
+    Outcome expected = runEngine(ENGINES[0], code, words);
+    for (size_t i = 1; i < sizeof(ENGINES) / sizeof(ENGINES[0]); i++) {
+        compare(ENGINES[i], expected, runEngine(ENGINES[i], code, words));
+    }
+    return 0;
+}
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv) {
+    (void)argc; (void)argv;
+    // The interpreter reports mode switches and halts on stderr
+    std::cerr.rdbuf(nullptr);
+    return 0;
+}
+
+#ifndef GTUSIM_LIBFUZZER
+int main(int argc, char* argv[]) {
+    std::streambuf* errors = std::cerr.rdbuf();
+    LLVMFuzzerInitialize(&argc, &argv);
+
+    // Replay inputs saved by libFuzzer
+    if (argc > 1 && !std::isdigit((unsigned char)argv[1][0])) {
+        for (int i = 1; i < argc; i++) {
+            std::ifstream file(argv[i], std::ios::binary);
+            std::vector<uint8_t> input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            LLVMFuzzerTestOneInput(input.data(), input.size());
+        }
+        std::cerr.rdbuf(errors);
+        std::cerr << "Replayed " << argc - 1 << " inputs, no mismatches" << std::endl;
+        return 0;
+    }
+
+    long iterations = argc > 1 ? std::stol(argv[1]) : 1000;
+    unsigned seed = argc > 2 ? (unsigned)std::stoul(argv[2]) : 1;
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> input;
+    for (long i = 0; i < iterations; i++) {
+        input.resize(rng() % 1100);
+        for (auto& byte : input) byte = (uint8_t)rng();
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    std::cerr.rdbuf(errors);
+    std::cerr << "Ran " << iterations << " random programs (seed " << seed << "), no mismatches" << std::endl;
+    return 0;
+}
+#endif
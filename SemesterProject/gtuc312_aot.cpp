@@ -0,0 +1,222 @@
+// Ahead-of-time translator from GTU-C312 programs to C++.
+//
+//   gtuc312-aot <program> [-o <output.cpp>] [--memory <words>]
+//
+// Loads the program like simulate, splits the loaded code into basic
+// blocks and writes one C++ function per block (see AotRuntime.h). The
+// output links against gtusim:
+//   g++ -std=c++20 -O2 -I<src> prog.cpp -L<build> -lgtusim -o prog
+#include "CPU.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const char* const MNEMONICS[] = {
+    "", "SET", "CPY", "CPYI", "ADD", "ADDI", "SUBI", "JIF",
+};
+
+// Opcodes the translator compiles; the rest are left to the interpreter
+static bool isNative(int opcode) {
+    return opcode >= 1 && opcode <= 7;
+}
+
+// Constant address an instruction stores to, -1 if it stores nothing
+static long storeTarget(const Instruction& inst) {
+    switch (inst.opcode) {
+        case 1: case 2: case 3: case 6: return inst.param2;
+        case 4: case 5: return inst.param1;
+        default: return -1;
+    }
+}
+
+struct Block {
+    long start;
+    long length;
+};
+
+// Leaders: the first native word after anything else, JIF and CALL
+// targets, and the word after a JIF. A block also ends at a region
+// boundary and after a store into its own remaining words, so the
+// modified words are fetched again.
+static std::vector<Block> findBlocks(const MemoryVector& memory) {
+    long size = (long)memory.size();
+    std::vector<bool> leader(size, false);
+    for (long address = THREAD_CODE_OFFSET; address < size; address++) {
+        Instruction inst = decodeInstruction(memory[address]);
+        if (inst.opcode == 7 && inst.param2 >= 0 && inst.param2 < size) leader[inst.param2] = true;
+        if (inst.opcode == 10 && inst.param1 >= 0 && inst.param1 < size) leader[inst.param1] = true;
+        if (inst.opcode == 7 && address + 1 < size) leader[address + 1] = true;
+    }
+
+    std::vector<Block> blocks;
+    long address = 0;
+    while (address < size) {
+        if (address % 1000 < THREAD_CODE_OFFSET || !isNative(decodeInstruction(memory[address]).opcode)) {
+            address++;
+            continue;
+        }
+        long end = address + 1;
+        while (end < size && end % 1000 != 0 && !leader[end] &&
+               decodeInstruction(memory[end - 1]).opcode != 7 &&
+               isNative(decodeInstruction(memory[end]).opcode)) {
+            end++;
+        }
+        for (long i = address; i < end; i++) {
+            long target = storeTarget(decodeInstruction(memory[i]));
+            if (target > i && target < end) {
+                end = i + 1;
+                break;
+            }
+        }
+        blocks.push_back({address, end - address});
+        address = end;
+    }
+    return blocks;
+}
+
+static void writeInstruction(std::ostream& out, const Instruction& inst, long address, long index) {
+    long p1 = inst.param1, p2 = inst.param2;
+    out << "    // " << address << ": " << MNEMONICS[inst.opcode] << " " << p1 << " " << p2 << "\n";
+    std::string exit = "return aotExit(s, " + std::to_string(index) + ", " + std::to_string(address) + ");";
+    switch (inst.opcode) {
+        case 1:  // SET B A
+            out << "    if (!aotValid(s, " << p2 << ")) " << exit << "\n"
+                << "    m[INSTR_CNT]++;\n"
+                << "    m[" << p2 << "] = " << p1 << ";\n";
+            break;
+        case 2:  // CPY A1 A2
+            out << "    if (!aotValid(s, " << p1 << ") || !aotValid(s, " << p2 << ")) " << exit << "\n"
+                << "    m[INSTR_CNT]++;\n"
+                << "    m[" << p2 << "] = m[" << p1 << "];\n";
+            break;
+        case 3:  // CPYI A1 A2
+            out << "    if (!aotValid(s, " << p1 << ") || !aotValid(s, " << p2 << ") || !aotValid(s, m[" << p1 << "])) "
+                << exit << "\n"
+                << "    m[INSTR_CNT]++;\n"
+                << "    m[" << p2 << "] = m[m[" << p1 << "]];\n";
+            break;
+        case 4:  // ADD A B
+            out << "    if (!aotValid(s, " << p1 << ")) " << exit << "\n"
+                << "    m[INSTR_CNT]++;\n"
+                << "    m[" << p1 << "] += " << p2 << ";\n";
+            break;
+        case 5:  // ADDI A1 A2
+            out << "    if (!aotValid(s, " << p1 << ") || !aotValid(s, " << p2 << ")) " << exit << "\n"
+                << "    m[INSTR_CNT]++;\n"
+                << "    m[" << p1 << "] += m[" << p2 << "];\n";
+            break;
+        case 6:  // SUBI A1 A2
+            out << "    if (!aotValid(s, " << p1 << ") || !aotValid(s, " << p2 << ")) " << exit << "\n"
+                << "    m[INSTR_CNT]++;\n"
+                << "    m[" << p2 << "] = m[" << p1 << "] - m[" << p2 << "];\n";
+            break;
+        case 7:  // JIF A C
+            out << "    if (!aotValid(s, " << p1 << ")) " << exit << "\n"
+                << "    m[INSTR_CNT]++;\n"
+                << "    if (m[" << p1 << "] <= 0 && aotJumpTarget(s, " << p2 << ")) return aotExit(s, "
+                << index + 1 << ", " << p2 << ");\n";
+            break;
+    }
+}
+
+// Escapes a path for a C++ string literal
+static std::string quoted(const std::string& text) {
+    std::string result = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') result += '\\';
+        result += c;
+    }
+    return result + "\"";
+}
+
+static void writeTranslation(std::ostream& out, const std::string& program, const MemoryVector& memory,
+                             const std::vector<Block>& blocks) {
+    out << "// Generated by gtuc312-aot from " << program << ". Do not edit.\n"
+        << "#include \"AotRuntime.h\"\n\n";
+
+    out << "static const long WORDS[] = {";
+    if (blocks.empty()) out << "0";
+    long words = 0;
+    for (const Block& block : blocks) {
+        for (long i = 0; i < block.length; i++) {
+            out << (words % 4 == 0 ? "\n    " : " ") << memory[block.start + i] << "L,";
+            words++;
+        }
+    }
+    out << "\n};\n";
+
+    for (const Block& block : blocks) {
+        out << "\nstatic long block" << block.start << "(AotState& s) {\n"
+            << "    long* m = s.memory;\n";
+        for (long i = 0; i < block.length; i++) {
+            writeInstruction(out, decodeInstruction(memory[block.start + i]), block.start + i, i);
+        }
+        out << "    return aotExit(s, " << block.length << ", " << block.start + block.length << ");\n"
+            << "}\n";
+    }
+
+    out << "\nstatic const AotBlock BLOCKS[] = {";
+    if (blocks.empty()) out << "\n    {0, 0, WORDS, nullptr},";
+    long offset = 0;
+    for (const Block& block : blocks) {
+        out << "\n    {" << block.start << ", " << block.length << ", WORDS + " << offset << ", block"
+            << block.start << "},";
+        offset += block.length;
+    }
+    out << "\n};\n\n"
+        << "int main(int argc, char* argv[]) {\n"
+        << "    return aotMain(argc, argv, " << quoted(program) << ", BLOCKS, " << blocks.size() << ");\n"
+        << "}\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string program, output;
+    size_t memorySize = CPU::DEFAULT_MEMORY_SIZE;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg == "--memory" && i + 1 < argc) {
+            memorySize = std::stoul(argv[++i]);
+        } else if (!arg.empty() && arg[0] != '-' && program.empty()) {
+            program = arg;
+        } else {
+            program.clear();
+            break;
+        }
+    }
+    if (program.empty()) {
+        std::cout << "Usage: gtuc312-aot <program> [-o <output.cpp>] [--memory <words>]" << std::endl;
+        return 1;
+    }
+    if (memorySize < 1000) {
+        std::cerr << "Error: Memory must hold at least the OS region (1000 words)" << std::endl;
+        return 1;
+    }
+    if (memorySize % 1000 != 0) {
+        std::cerr << "Error: Memory size must be a multiple of the 1000-word thread region" << std::endl;
+        return 1;
+    }
+
+    CPU cpu(memorySize);
+    if (!cpu.loadProgram(program)) {
+        return 1;
+    }
+    const MemoryVector& memory = cpu.getMemory();
+    std::vector<Block> blocks = findBlocks(memory);
+
+    std::ostringstream text;
+    writeTranslation(text, program, memory, blocks);
+    if (output.empty()) {
+        std::cout << text.str();
+        return 0;
+    }
+    std::ofstream file(output);
+    if (!(file << text.str())) {
+        std::cerr << "Error: Could not write " << output << std::endl;
+        return 1;
+    }
+    return 0;
+}
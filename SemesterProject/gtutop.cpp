@@ -0,0 +1,108 @@
+// Read-only viewer for a simulation started with simulate --shm <name>.
+//
+//   gtutop <name> [--interval <ms>] [--words <start> <count>] [--once]
+//
+// Maps the segment read-only and redraws the published status (PC,
+// counters, thread states) every interval, plus optionally a live range of
+// memory words. Exits when the simulation halts.
+#include "CPU.h"
+#include "SharedMemory.h"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+static const char* stateName(int64_t state) {
+    return state == READY ? "READY" :
+           state == RUNNING ? "RUNNING" :
+           state == BLOCKED ? "BLOCKED" :
+           state == TERMINATED ? "TERMINATED" : "?";
+}
+
+static void draw(const SharedSegment& segment, const SharedStatus& status, double rate,
+                 long wordStart, long wordCount) {
+    std::cout << "gtusim " << segment.getName() << "  " << segment.getMemoryWords() << " words  "
+              << (status.halted ? "HALTED" : "RUNNING") << std::endl;
+    std::cout << "PC " << status.pc << "  thread " << status.currentThread
+              << (status.kernelMode ? "  kernel mode" : "  user mode") << std::endl;
+    std::cout << "Instructions " << status.instructionCount << "  cycles " << status.cycleCount
+              << "  context switches " << status.contextSwitches;
+    if (rate >= 0) std::cout << "  " << std::fixed << std::setprecision(1) << rate / 1e6 << "M instr/s";
+    std::cout << std::endl << std::endl;
+
+    std::cout << std::setw(6) << "Thread" << std::setw(12) << "State" << std::setw(8) << "PC"
+              << std::setw(16) << "Instructions" << std::setw(10) << "Switches" << std::endl;
+    for (int64_t i = 0; i < status.threadCount; i++) {
+        const SharedThreadStatus& thread = status.threads[i];
+        if (thread.executionCount == 0 && thread.instructions == 0 && i != status.currentThread) continue;
+        std::cout << std::setw(6) << i << std::setw(12) << stateName(thread.state) << std::setw(8) << thread.pc
+                  << std::setw(16) << thread.instructions << std::setw(10) << thread.executionCount << std::endl;
+    }
+
+    // Words are read live, outside the seqlock
+    if (wordCount > 0) {
+        std::cout << std::endl;
+        const long* words = segment.words();
+        for (long a = wordStart; a < wordStart + wordCount && a < (long)segment.getMemoryWords(); a++) {
+            std::cout << "Address " << std::setw(5) << a << ": " << std::setw(15) << words[a] << std::endl;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string name;
+    long intervalMs = 500;
+    long wordStart = 0;
+    long wordCount = 0;
+    bool once = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--interval" && i + 1 < argc) {
+            intervalMs = std::stol(argv[++i]);
+        } else if (arg == "--words" && i + 2 < argc) {
+            wordStart = std::stol(argv[++i]);
+            wordCount = std::stol(argv[++i]);
+        } else if (arg == "--once") {
+            once = true;
+        } else if (!arg.empty() && arg[0] != '-' && name.empty()) {
+            name = arg;
+        } else {
+            name.clear();
+            break;
+        }
+    }
+    if (name.empty() || intervalMs <= 0 || wordStart < 0) {
+        std::cout << "Usage: gtutop <name> [--interval <ms>] [--words <start> <count>] [--once]" << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<SharedSegment> segment = attachSharedSegment(name);
+    if (!segment) {
+        return 1;
+    }
+
+    bool terminal = isatty(STDOUT_FILENO);
+    long lastInstructions = -1;
+    auto lastTime = std::chrono::steady_clock::now();
+    while (true) {
+        SharedStatus status;
+        if (!segment->snapshot(status)) {
+            std::cerr << "Error: The simulator stopped in the middle of an update" << std::endl;
+            return 1;
+        }
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - lastTime).count();
+        double rate = lastInstructions >= 0 && seconds > 0 ? (status.instructionCount - lastInstructions) / seconds : -1;
+        lastInstructions = status.instructionCount;
+        lastTime = now;
+
+        if (terminal && !once) std::cout << "\033[H\033[2J";
+        draw(*segment, status, rate, wordStart, wordCount);
+        if (once || status.halted) break;
+        if (!terminal) std::cout << "----------------------------------------" << std::endl;
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+    }
+    return 0;
+}
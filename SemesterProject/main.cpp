@@ -1,13 +1,44 @@
 #include "CPU.h"
+#include "GdbStub.h"
+#include "HostServices.h"
+#include "Jit.h"
+#include <chrono>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <utility>
 
 void printUsage() {
-    std::cout << "Usage: simulate <filename> [-D <debug_mode>]" << std::endl;
+    std::cout << "Usage: simulate <filename> [thread files...] [-D <debug_mode>] [--thread-output <prefix>]" << std::endl;
+    std::cout << "  With thread files, <filename> is the OS image and thread file i is linked into region i" << std::endl;
     std::cout << "Debug modes:" << std::endl;
     std::cout << "  0: Print memory state after CPU halts" << std::endl;
     std::cout << "  1: Print memory state after each instruction" << std::endl;
     std::cout << "  2: Print memory state after each instruction and wait for keypress" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --memory <words>: Memory size (default 11000, a multiple of the 1000-word thread region)" << std::endl;
+    std::cout << "  --thread-output <prefix>: Write each thread's PRN output to <prefix>_thread<N>.txt" << std::endl;
+    std::cout << "  --cycle-costs <file>: Load per-opcode cycle costs (implies --cycle-report)" << std::endl;
+    std::cout << "  --cycle-report: Print per-thread simulated cycles after the CPU halts" << std::endl;
+    std::cout << "  --thread-table <address>: Fill last execution / blocked time words of the OS thread table" << std::endl;
+    std::cout << "  --sched <rr|priority|mlfq|lottery>: Let the simulator schedule the threads" << std::endl;
+    std::cout << "  --quantum <cycles>: Time slice for --sched (default 50)" << std::endl;
+    std::cout << "  --priority <thread>=<value>: Thread priority for --sched (repeatable)" << std::endl;
+    std::cout << "  --vm: Give each user thread its own virtual address space at 1000 (needs --sched)" << std::endl;
+    std::cout << "  --stack-size <words>: Stack segment below each thread's initial SP (default 200)" << std::endl;
+    std::cout << "  --stats <file>: Write run statistics as JSON, or CSV if the name ends in .csv (- for stdout)" << std::endl;
+    std::cout << "  --jit: Compile hot blocks to native x86-64 code (interprets elsewhere)" << std::endl;
+    std::cout << "  --jit-threshold <n>: Executions before a block is compiled (default 50, implies --jit)" << std::endl;
+    std::cout << "  --disk <file>: Back the block device with a host file of 8-byte words" << std::endl;
+    std::cout << "  --console-input <file>: Read the input console from a file instead of stdin" << std::endl;
+    std::cout << "  --io-latency <cycles>: Cycles per device request (default 100 disk, 50 console)" << std::endl;
+    std::cout << "  --record <file>: Log every host input (device data, host syscall results, keys) to file" << std::endl;
+    std::cout << "  --replay <file>: Feed a recorded log back in and check the final memory hash" << std::endl;
+    std::cout << "  --shm <name>: Keep memory in POSIX shared memory <name> so gtutop can watch the run" << std::endl;
+    std::cout << "  --gdb-port <port>: Wait for GDB on 127.0.0.1:<port> and run under its control" << std::endl;
+    std::cout << "  --cache <spec>: Simulate caches, e.g. l1=64x2x4,l2=256x4x8,lru,wb (needs GTUSIM_CACHE_MODEL)" << std::endl;
+    std::cout << "  --seed <n>: Random seed for the lottery scheduler (default 1)" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
@@ -18,6 +49,29 @@ int main(int argc, char* argv[]) {
 
     std::string filename = argv[1];
     int debugMode = 0;
+    std::string threadOutputPrefix;
+    size_t memorySize = CPU::DEFAULT_MEMORY_SIZE;
+    std::string cycleCostFile;
+    bool cycleReport = false;
+    long threadTableAddress = 0;
+    std::string schedulerName;
+    long quantum = 50;
+    unsigned seed = 1;
+    std::vector<std::pair<int, int>> priorities;
+    std::string cacheSpec;
+    std::vector<std::string> threadFiles;
+    std::string statsFile;
+    bool virtualMemory = false;
+    long stackSize = CPU::DEFAULT_STACK_WORDS;
+    bool jit = false;
+    int gdbPort = 0;
+    std::string sharedName;
+    std::string diskFile;
+    std::string consoleInputFile;
+    long ioLatency = -1;
+    std::string recordFile;
+    std::string replayFile;
+    long jitThreshold = Jit::DEFAULT_THRESHOLD;
 
     // Parse command line arguments
     for (int i = 2; i < argc; i++) {
@@ -25,45 +79,230 @@ int main(int argc, char* argv[]) {
         if (arg == "-D" && i + 1 < argc) {
             debugMode = std::stoi(argv[i + 1]);
             i++;
+        } else if (arg == "--memory" && i + 1 < argc) {
+            memorySize = std::stoul(argv[i + 1]);
+            i++;
+        } else if (arg == "--thread-output" && i + 1 < argc) {
+            threadOutputPrefix = argv[i + 1];
+            i++;
+        } else if (arg == "--cycle-costs" && i + 1 < argc) {
+            cycleCostFile = argv[i + 1];
+            cycleReport = true;
+            i++;
+        } else if (arg == "--cycle-report") {
+            cycleReport = true;
+        } else if (arg == "--thread-table" && i + 1 < argc) {
+            threadTableAddress = std::stol(argv[i + 1]);
+            i++;
+        } else if (arg == "--sched" && i + 1 < argc) {
+            schedulerName = argv[i + 1];
+            i++;
+        } else if (arg == "--quantum" && i + 1 < argc) {
+            quantum = std::stol(argv[i + 1]);
+            i++;
+        } else if (arg == "--stack-size" && i + 1 < argc) {
+            stackSize = std::stol(argv[i + 1]);
+            i++;
+        } else if (arg == "--gdb-port" && i + 1 < argc) {
+            gdbPort = std::stoi(argv[i + 1]);
+            i++;
+        } else if (arg == "--jit") {
+            jit = true;
+        } else if (arg == "--jit-threshold" && i + 1 < argc) {
+            jitThreshold = std::stol(argv[i + 1]);
+            jit = true;
+            i++;
+        } else if (arg == "--shm" && i + 1 < argc) {
+            sharedName = argv[i + 1];
+            i++;
+        } else if (arg == "--stats" && i + 1 < argc) {
+            statsFile = argv[i + 1];
+            i++;
+        } else if (arg == "--disk" && i + 1 < argc) {
+            diskFile = argv[i + 1];
+            i++;
+        } else if (arg == "--console-input" && i + 1 < argc) {
+            consoleInputFile = argv[i + 1];
+            i++;
+        } else if (arg == "--io-latency" && i + 1 < argc) {
+            ioLatency = std::stol(argv[i + 1]);
+            i++;
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordFile = argv[i + 1];
+            i++;
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayFile = argv[i + 1];
+            i++;
+        } else if (arg == "--vm") {
+            virtualMemory = true;
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cacheSpec = argv[i + 1];
+            i++;
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = (unsigned)std::stoul(argv[i + 1]);
+            i++;
+        } else if (arg == "--priority" && i + 1 < argc) {
+            std::string value = argv[i + 1];
+            size_t eq = value.find('=');
+            if (eq == std::string::npos) {
+                std::cerr << "Error: --priority expects <thread>=<value>" << std::endl;
+                return 1;
+            }
+            priorities.push_back({std::stoi(value.substr(0, eq)), std::stoi(value.substr(eq + 1))});
+            i++;
+        } else if (!arg.empty() && arg[0] != '-') {
+            threadFiles.push_back(arg);
         }
     }
 
-    CPU cpu;
-    cpu.setDebugMode(debugMode);
-    cpu.loadProgram(filename);
+    if (memorySize < 1000) {
+        std::cerr << "Error: Memory must hold at least the OS region (1000 words)" << std::endl;
+        return 1;
+    }
+    // Every region needs its own thread table entry
+    if (memorySize % 1000 != 0) {
+        std::cerr << "Error: Memory size must be a multiple of the 1000-word thread region" << std::endl;
+        return 1;
+    }
 
-    if (debugMode > 0) {
-        std::cerr << "DEBUG: PC after loadProgram: " << cpu.getMemoryValue(0) << std::endl;
+    if (!recordFile.empty() && !replayFile.empty()) {
+        std::cerr << "Error: --record and --replay cannot be used together" << std::endl;
+        return 1;
+    }
+    // A replay needs no tracing or keypresses, so it runs at full speed
+    if (!replayFile.empty() && debugMode > 0) {
+        std::cerr << "Note: --replay runs with debug mode 0" << std::endl;
+        debugMode = 0;
+    }
+
+    if (virtualMemory && schedulerName.empty()) {
+        std::cerr << "Error: --vm needs --sched, the OS cannot tell threads apart by virtual PC" << std::endl;
+        return 1;
+    }
+
+    CPU cpu(memorySize);
+    if (!sharedName.empty() && !cpu.shareMemory(sharedName)) {
+        return 1;
+    }
+    cpu.setVirtualMemory(virtualMemory);
+    if (!cpu.setStackSize(stackSize)) {
+        return 1;
+    }
+    cpu.setDebugMode(debugMode);
+    registerHostServices(cpu);
+    if (!threadOutputPrefix.empty()) {
+        cpu.setThreadOutputPrefix(threadOutputPrefix);
+    }
+    if (!cycleCostFile.empty() && !cpu.loadCycleCosts(cycleCostFile)) {
+        return 1;
+    }
+    if (!diskFile.empty() && !cpu.getDisk().open(diskFile)) {
+        return 1;
+    }
+    if (!consoleInputFile.empty() && !cpu.getConsoleInput().open(consoleInputFile)) {
+        return 1;
+    }
+    if (!recordFile.empty() && !cpu.recordInputs(recordFile)) {
+        return 1;
+    }
+    if (!replayFile.empty() && !cpu.replayInputs(replayFile)) {
+        return 1;
+    }
+    if (ioLatency >= 0) {
+        cpu.getDisk().setLatency(ioLatency);
+        cpu.getConsoleInput().setLatency(ioLatency);
+    }
+    cpu.setThreadTableAddress(threadTableAddress);
+    if (!cacheSpec.empty()) {
+#ifdef GTUSIM_CACHE_MODEL
+        CacheConfig cacheConfig;
+        if (!parseCacheSpec(cacheSpec, cacheConfig)) {
+            std::cerr << "Error: Invalid cache specification " << cacheSpec << std::endl;
+            return 1;
+        }
+        cpu.setCacheModel(std::unique_ptr<CacheHierarchy>(new CacheHierarchy(cacheConfig)));
+#else
+        std::cerr << "Error: --cache needs a build with -DGTUSIM_CACHE_MODEL=ON" << std::endl;
+        return 1;
+#endif
+    }
+    bool loaded = threadFiles.empty() ? cpu.loadProgram(filename) : cpu.linkProgram(filename, threadFiles);
+    if (!loaded) {
+        return 1;
+    }
+    if (!schedulerName.empty()) {
+        std::unique_ptr<Scheduler> scheduler = createScheduler(schedulerName, quantum,
+                                                               (int)cpu.getThreadTable().size(), seed);
+        if (!scheduler || quantum <= 0) {
+            std::cerr << "Error: Unknown scheduler " << schedulerName << " or invalid quantum" << std::endl;
+            return 1;
+        }
+        cpu.setScheduler(std::move(scheduler));
+        for (const auto& priority : priorities) {
+            cpu.setThreadPriority(priority.first, priority.second);
+        }
     }
 
-    // Workaround: Explicitly ensure the first instruction is correctly loaded at memory[100]
-    long first_instruction_value = 0;
-    if (filename == "../sample.txt") {
-        first_instruction_value = 1000010000050LL; // Encoded value of SET 10 50
-    } else if (filename == "../combined.txt") {
-        first_instruction_value = 1000021000007LL; // Encoded value of SET 21 7
-    }
-    if (first_instruction_value != 0) {
-         cpu.setMemoryValue(100, first_instruction_value);
-         if (debugMode > 0) {
-             std::cerr << "DEBUG: Workaround: Explicitly set memory[100] to: " << first_instruction_value << std::endl;
-         }
-    }
-    
     if (debugMode > 0) {
-        std::cerr << "DEBUG: PC at start of while loop: " << cpu.getMemoryValue(0) << std::endl;
+        std::cerr << "DEBUG: PC after loadProgram: " << cpu.getMemoryValue(0) << std::endl;
         std::cerr << "DEBUG: Starting CPU execution loop." << std::endl;
     }
-    while (!cpu.isHalted()) {
-        cpu.execute();
+    auto runStart = std::chrono::steady_clock::now();
+    if (gdbPort > 0) {
+        GdbStub stub(cpu);
+        if (!stub.listen(gdbPort) || !stub.serve()) {
+            return 1;
+        }
+        if (!stub.wasKilled()) {
+            cpu.run();
+        }
+    } else if (jit) {
+        Jit compiler(jitThreshold);
+        compiler.run(cpu);
+        if (debugMode > 0) {
+            std::cerr << "DEBUG: JIT compiled " << compiler.getCompiledBlocks() << " blocks, ran "
+                      << compiler.getNativeInstructions() << " instructions natively" << std::endl;
+        }
+    } else {
+        cpu.run();
     }
+    std::chrono::duration<double> wallTime = std::chrono::steady_clock::now() - runStart;
     if (debugMode > 0) {
         std::cerr << "DEBUG: CPU execution loop finished. CPU halted: " << cpu.isHalted() << std::endl;
     }
 
+    // Write out whatever the threads printed before the final memory dump
+    cpu.flushOutput();
+    bool replayMatched = cpu.finishInputLog();
+
     if (debugMode == 0) {
         cpu.printMemoryState();
     }
+    if (cycleReport) {
+        cpu.printCycleReport(std::cout);
+    }
+    if (virtualMemory) {
+        cpu.printTlbReport(std::cout);
+    }
+#ifdef GTUSIM_CACHE_MODEL
+    if (cpu.getCacheModel()) {
+        cpu.getCacheModel()->printReport(std::cout);
+    }
+#endif
+    if (!statsFile.empty()) {
+        bool csv = statsFile.size() > 4 && statsFile.compare(statsFile.size() - 4, 4, ".csv") == 0;
+        CPU::StatsFormat format = csv ? CPU::STATS_CSV : CPU::STATS_JSON;
+        if (statsFile == "-") {
+            cpu.printStats(std::cout, format, wallTime.count());
+        } else {
+            std::ofstream stats(statsFile);
+            if (!stats.is_open()) {
+                std::cerr << "Error: Could not open stats file " << statsFile << std::endl;
+                return 1;
+            }
+            cpu.printStats(stats, format, wallTime.count());
+        }
+    }
 
-    return 0;
+    return replayMatched ? 0 : 1;
 } 
\ No newline at end of file
@@ -0,0 +1,317 @@
+// Golden-output regression suite for the bundled and golden programs (run by ctest).
+//
+//   golden_tests <case> <engine>   check one case on one engine
+//   golden_tests --print           print the interpreter's results as GOLDEN rows
+//
+// Each case is loaded the way simulate loads it and run to the halt. The
+// final memory hash, instruction count, context switches and PRN output
+// must match the GOLDEN row. Runs of at least MIN_TIMED_INSTRUCTIONS must
+// also reach the engine's minimum rate, set far below what a debug build
+// does, so only a gross slowdown (like a JIT that recompiles every block) fails.
+// Cases marked native must also run partly natively on the JIT and the
+// lockstep engine, so a silent fallback to the interpreter fails.
+//
+// The lockstep engine runs LOCKSTEP_LANES lanes. Lane l adds l to the
+// case's seed word, so the lanes diverge and meet again; lane 0 is checked
+// against GOLDEN and the others against the interpreter on the same data.
+//
+// Run from the source directory (ctest sets the working directory).
+// After an intended change, regenerate the rows with --print.
+#include "CPU.h"
+#include "HostServices.h"
+#include "Jit.h"
+#include "Lockstep.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Runs that do not halt within this many instructions fail
+static const long MAX_STEPS = 10000000;
+static const int LOCKSTEP_LANES = 4;
+static const long GOLDEN_QUANTUM = 20;
+static const long MIN_TIMED_INSTRUCTIONS = 100000;
+
+struct Case {
+    const char* name;
+    const char* program;  // Program file, or the OS image if threads is set
+    const char* threads;  // Thread images to link, separated by blanks
+    const char* sched;    // --sched policy, nullptr = the OS code switches threads
+    bool vm;              // --vm
+    long seedAddress;     // Word lockstep lane l adds l to, 0 = identical lanes
+    bool native;          // JIT and lockstep must run part of it natively
+    long threadTable;     // --thread-table address, 0 = none
+};
+
+static const char* const GOLDEN_THREADS =
+    "tests/counter_thread.txt tests/producer_thread.txt tests/consumer_thread.txt";
+
+static const Case CASES[] = {
+    {"sample", "sample.txt", nullptr, nullptr, false, 0, false, 0},
+    {"test", "test.txt", nullptr, nullptr, false, 0, false, 0},
+    {"combined", "combined.txt", nullptr, nullptr, false, 0, false, 0},
+    {"linked", "os.txt", "sort_thread.txt search_thread.txt custom_thread.txt", "rr", false, 0, false, 0},
+    {"loops", "tests/loops.txt", nullptr, nullptr, false, 30, true, 0},
+    {"stack", "tests/stack.txt", nullptr, nullptr, false, 0, false, 0},
+    {"sync_poll", "tests/sync_poll.txt", nullptr, nullptr, false, 0, false, 0},
+    {"thread_table", "tests/thread_table.txt", nullptr, nullptr, false, 0, true, 30},
+    {"threads_rr", "tests/threads_os.txt", GOLDEN_THREADS, "rr", false, 0, false, 0},
+    {"threads_priority", "tests/threads_os.txt", GOLDEN_THREADS, "priority", false, 0, false, 0},
+    {"threads_mlfq", "tests/threads_os.txt", GOLDEN_THREADS, "mlfq", false, 0, false, 0},
+    {"threads_lottery", "tests/threads_os.txt", GOLDEN_THREADS, "lottery", false, 0, false, 0},
+    {"threads_rr_vm", "tests/threads_os.txt", GOLDEN_THREADS, "rr", true, 0, false, 0},
+};
+
+struct Golden {
+    const char* name;
+    uint64_t memoryHash;
+    long instructions;
+    long contextSwitches;
+    const char* output;  // PRN output, one value per line
+};
+
+static const Golden GOLDEN[] = {
+    {"sample", 0x56e4662357b112eaULL, 8, 0, "51\n"},
+    {"test", 0x8065a30d8aeadca9ULL, 22, 0, ""},
+    {"combined", 0x0603393da3a09afcULL, 28, 0, ""},
+    {"linked", 0xf55d5326adac7509ULL, 82, 4, ""},
+    {"loops", 0xa335bd2e55caf0bbULL, 727136, 1, "180300\n350\n75025\n405450\n1\n0\n1\n"},
+    {"stack", 0x348c59a0ef0fb04eULL, 7, 0, "51\n"},
+    {"sync_poll", 0xb4ead290ef3d2c80ULL, 31, 1, "1\n0\n"},
+    {"thread_table", 0x3d1a08421f369139ULL, 11, 2, "3\n"},
+    {"threads_rr", 0xa776595200632d0aULL, 2461, 70, "1\n0\n12\n0\n1\n4\n9\n16\n25\n36\n49\n64\n81\n100\n121\n144\n650\n0\n0\n45150\n"},
+    {"threads_priority", 0xa776595200632d0aULL, 2461, 27, "1\n1\n4\n9\n16\n25\n36\n49\n64\n81\n100\n121\n144\n650\n0\n0\n12\n0\n0\n45150\n"},
+    {"threads_mlfq", 0xa776595200632d0aULL, 2461, 39, "1\n1\n4\n9\n16\n25\n36\n49\n64\n81\n100\n121\n144\n650\n0\n0\n12\n0\n0\n45150\n"},
+    {"threads_lottery", 0x34c2358e4dff7ba8ULL, 2479, 45, "1\n0\n12\n0\n1\n4\n9\n16\n25\n36\n49\n64\n81\n100\n121\n144\n650\n0\n0\n45150\n"},
+    {"threads_rr_vm", 0x8a3f6ee8a3eb2bf7ULL, 2461, 70, "1\n0\n12\n0\n1\n4\n9\n16\n25\n36\n49\n64\n81\n100\n121\n144\n650\n0\n0\n45150\n"},
+};
+
+struct Result {
+    uint64_t memoryHash;
+    long instructions;
+    long contextSwitches;
+    bool halted;
+};
+
+using Lanes = std::vector<std::unique_ptr<CPU>>;
+
+struct Engine {
+    const char* name;
+    int lanes;
+    long (*run)(Lanes& cpus);  // Returns the instructions run natively
+    double minRate;            // Instructions per second over all lanes
+};
+
+static long runInterpreter(Lanes& cpus) {
+    cpus[0]->run(MAX_STEPS);
+    return 0;
+}
+
+// Threshold 1 compiles every block on first use
+static long runJit(Lanes& cpus) {
+    Jit jit(1);
+    jit.run(*cpus[0], MAX_STEPS);
+    return jit.getNativeInstructions();
+}
+
+static long runLockstep(Lanes& cpus) {
+    LockstepEngine engine;
+    for (auto& cpu : cpus) engine.addLane(*cpu);
+    engine.run(MAX_STEPS);
+    return engine.getVectorSteps();
+}
+
+static const Engine ENGINES[] = {
+    {"interpreter", 1, runInterpreter, 1e6},
+    {"jit", 1, runJit, 2e7},
+    {"lockstep", LOCKSTEP_LANES, runLockstep, 1e6},
+};
+
+// Same setup as simulate <program> or simulate <os> <threads> --sched <policy>
+// --quantum 20 --priority 0=4 --priority 1=1 --priority 2=2 --priority 3=3 [--vm]
+// [--thread-table <address>]
+static bool setup(CPU& cpu, const Case& c, int lane) {
+    registerHostServices(cpu);
+    cpu.setVirtualMemory(c.vm);
+    cpu.setThreadTableAddress(c.threadTable);
+    if (!c.threads) {
+        if (!cpu.loadProgram(c.program)) return false;
+    } else {
+        std::vector<std::string> threadFiles;
+        std::istringstream names(c.threads);
+        for (std::string name; names >> name;) threadFiles.push_back(name);
+        if (!cpu.linkProgram(c.program, threadFiles)) return false;
+    }
+    if (c.sched) {
+        int threadCount = (int)cpu.getThreadTable().size();
+        cpu.setScheduler(createScheduler(c.sched, GOLDEN_QUANTUM, threadCount, 1));
+        // The OS goes first, so its semaphore exists before the threads use it
+        cpu.setThreadPriority(0, 4);
+        for (int id = 1; id <= 3 && id < threadCount; id++) cpu.setThreadPriority(id, id);
+    }
+    if (c.seedAddress > 0) cpu.setMemoryValue((int)c.seedAddress, cpu.getMemoryValue((int)c.seedAddress) + lane);
+    return true;
+}
+
+static Result resultOf(const CPU& cpu) {
+    return {cpu.getMemoryHash(), cpu.getInstructionCount(), cpu.getContextSwitches(), cpu.isHalted()};
+}
+
+// Runs every lane of c on engine; output gets the PRN output of all lanes
+static bool runCase(const Case& c, const Engine& engine, std::vector<Result>& results, std::string& output,
+                    double& seconds, long& native) {
+    Lanes cpus;
+    for (int lane = 0; lane < engine.lanes; lane++) {
+        cpus.push_back(std::make_unique<CPU>());
+        if (!setup(*cpus.back(), c, lane)) return false;
+    }
+    // PRN output goes to std::cout when it is flushed
+    std::ostringstream captured;
+    std::streambuf* saved = std::cout.rdbuf(captured.rdbuf());
+    auto start = std::chrono::steady_clock::now();
+    native = engine.run(cpus);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    for (auto& cpu : cpus) cpu->flushOutput();
+    std::cout.rdbuf(saved);
+
+    results.clear();
+    for (auto& cpu : cpus) results.push_back(resultOf(*cpu));
+    output = captured.str();
+    seconds = elapsed.count();
+    return true;
+}
+
+// Interpreter run of one lane, the reference for the other lockstep lanes
+static bool runReference(const Case& c, int lane, Result& result, std::string& output) {
+    CPU cpu;
+    if (!setup(cpu, c, lane)) return false;
+    std::ostringstream captured;
+    std::streambuf* saved = std::cout.rdbuf(captured.rdbuf());
+    cpu.run(MAX_STEPS);
+    cpu.flushOutput();
+    std::cout.rdbuf(saved);
+    result = resultOf(cpu);
+    output = captured.str();
+    return true;
+}
+
+// Lanes flush their output as they halt, so lockstep output is compared by lines
+static std::vector<std::string> sortedLines(const std::string& text) {
+    std::vector<std::string> lines;
+    std::istringstream in(text);
+    for (std::string line; std::getline(in, line);) lines.push_back(line);
+    std::sort(lines.begin(), lines.end());
+    return lines;
+}
+
+static std::string escaped(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) out += c == '\n' ? std::string("\\n") : std::string(1, c);
+    return out + "\"";
+}
+
+static bool check(const char* what, const Result& result, const Golden& golden) {
+    bool ok = true;
+    if (!result.halted) {
+        std::cerr << "FAIL: " << what << " did not halt within " << MAX_STEPS << " instructions" << std::endl;
+        ok = false;
+    }
+    if (result.memoryHash != golden.memoryHash) {
+        std::cerr << "FAIL: " << what << " memory hash " << std::hex << result.memoryHash << ", expected "
+                  << golden.memoryHash << std::dec << std::endl;
+        ok = false;
+    }
+    if (result.instructions != golden.instructions) {
+        std::cerr << "FAIL: " << what << " ran " << result.instructions << " instructions, expected "
+                  << golden.instructions << std::endl;
+        ok = false;
+    }
+    if (result.contextSwitches != golden.contextSwitches) {
+        std::cerr << "FAIL: " << what << " made " << result.contextSwitches << " context switches, expected "
+                  << golden.contextSwitches << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+static int printTable() {
+    for (const Case& c : CASES) {
+        std::vector<Result> results;
+        std::string output;
+        double seconds;
+        long native;
+        if (!runCase(c, ENGINES[0], results, output, seconds, native)) return 1;
+        char hash[32];
+        std::snprintf(hash, sizeof(hash), "0x%016llxULL", (unsigned long long)results[0].memoryHash);
+        std::cout << "    {\"" << c.name << "\", " << hash << ", " << results[0].instructions << ", "
+                  << results[0].contextSwitches << ", " << escaped(output) << "}," << std::endl;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 2 && std::string(argv[1]) == "--print") {
+        return printTable();
+    }
+    const Case* c = nullptr;
+    const Golden* golden = nullptr;
+    const Engine* engine = nullptr;
+    for (const Case& entry : CASES) {
+        if (argc == 3 && entry.name == std::string(argv[1])) c = &entry;
+    }
+    for (const Golden& entry : GOLDEN) {
+        if (argc == 3 && entry.name == std::string(argv[1])) golden = &entry;
+    }
+    for (const Engine& entry : ENGINES) {
+        if (argc == 3 && entry.name == std::string(argv[2])) engine = &entry;
+    }
+    if (!c || !engine) {
+        std::cout << "Usage: golden_tests <case> <engine> | --print" << std::endl;
+        return 1;
+    }
+    if (!golden) {
+        std::cerr << "FAIL: no GOLDEN row for " << c->name << ", add the one --print shows" << std::endl;
+        return 1;
+    }
+
+    std::vector<Result> results;
+    std::string output;
+    double seconds;
+    long native;
+    if (!runCase(*c, *engine, results, output, seconds, native)) {
+        std::cerr << "FAIL: could not load " << c->name << std::endl;
+        return 1;
+    }
+    bool ok = check("lane 0", results[0], *golden);
+    std::string expectedOutput = golden->output;
+    for (int lane = 1; lane < engine->lanes; lane++) {
+        Result reference;
+        std::string laneOutput;
+        if (!runReference(*c, lane, reference, laneOutput)) return 1;
+        Golden laneGolden = {c->name, reference.memoryHash, reference.instructions, reference.contextSwitches, ""};
+        ok = check(("lane " + std::to_string(lane)).c_str(), results[lane], laneGolden) && ok;
+        expectedOutput += laneOutput;
+    }
+    if (sortedLines(output) != sortedLines(expectedOutput)) {
+        std::cerr << "FAIL: PRN output " << escaped(output) << ", expected " << escaped(expectedOutput) << std::endl;
+        ok = false;
+    }
+    if (c->native && engine->run != runInterpreter && native == 0) {
+        std::cerr << "FAIL: " << engine->name << " ran no instructions natively" << std::endl;
+        ok = false;
+    }
+    long total = 0;
+    for (const Result& result : results) total += result.instructions;
+    if (results[0].instructions >= MIN_TIMED_INSTRUCTIONS && total < seconds * engine->minRate) {
+        std::cerr << "FAIL: " << total / seconds << " instructions per second, minimum " << engine->minRate << std::endl;
+        ok = false;
+    }
+    std::cout << c->name << " on " << engine->name << ": " << results[0].instructions << " instructions, "
+              << native << " native, in " << seconds << " s" << (ok ? "" : " (FAILED)") << std::endl;
+    return ok ? 0 : 1;
+}